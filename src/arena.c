@@ -0,0 +1,61 @@
+#include "drawdag.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN     16
+#define ARENA_MIN_BLOCK 4096
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used, cap;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+/* ---- helpers ---- */
+
+static ArenaBlock *block_new(Arena *a, size_t cap) {
+    ArenaBlock *b = a->mem.alloc ? a->mem.alloc(a->mem.ctx, sizeof *b + cap)
+                                 : malloc(sizeof *b + cap);
+    if (!b) return NULL;
+    b->next = NULL;
+    b->used = 0;
+    b->cap = cap;
+    return b;
+}
+
+/* ---- public API ---- */
+
+/* Blocks come from mem, or from malloc when mem is NULL. */
+void arena_init(Arena *a, size_t size_hint, const DdAllocator *mem) {
+    a->head = NULL;
+    a->block_size = size_hint > ARENA_MIN_BLOCK ? size_hint : ARENA_MIN_BLOCK;
+    a->mem = mem ? *mem : (DdAllocator){0};
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!a->head || a->head->cap - a->head->used < size) {
+        /* the first block gets the full hint, overflow blocks grow with it */
+        size_t cap = a->block_size;
+        if (cap < size) cap = size;
+        ArenaBlock *b = block_new(a, cap);
+        if (!b) return NULL;
+        b->next = a->head;
+        a->head = b;
+    }
+    void *p = a->head->data + a->head->used;
+    a->head->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+void arena_free(Arena *a) {
+    while (a->head) {
+        ArenaBlock *next = a->head->next;
+        if (a->mem.free) a->mem.free(a->mem.ctx, a->head);
+        else             free(a->head);
+        a->head = next;
+    }
+}
@@ -0,0 +1,345 @@
+#include "drawdag.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Graphs in flight between the reader and the writer: read, being
+ * rendered or waiting to be written. */
+#define BATCH_WINDOW 256
+
+typedef struct {
+    char *name;
+    char *path;             /* input file, or NULL for a stream chunk */
+    char *text;
+    size_t text_len;
+    char *out;              /* rendered drawing */
+    size_t out_len;
+    const char *error;
+    bool done;
+} Job;
+
+/* Job i lives in ring[i % BATCH_WINDOW] from the time the reader adds it
+ * until the writer has written it. */
+typedef struct {
+    Job ring[BATCH_WINDOW];
+    const BatchOptions *opt;
+    const char *input;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;  /* a job was added, or the input ended */
+    pthread_cond_t ready;   /* a job finished, or the input ended */
+    pthread_cond_t room;    /* the writer freed a slot */
+    int count;              /* jobs read so far */
+    int next, written;
+    bool input_done, input_ok;
+} Batch;
+
+/* Per-worker buffers, too big for a thread stack. */
+typedef struct {
+    Graph g;
+    Canvas cv;
+} Scratch;
+
+/* ---- reading ---- */
+
+/* Hand a job to the workers, waiting while the window is full. Takes
+ * ownership of the job's strings. */
+static void add_job(Batch *b, const Job *job) {
+    pthread_mutex_lock(&b->lock);
+    while (b->count - b->written >= BATCH_WINDOW)
+        pthread_cond_wait(&b->room, &b->lock);
+    b->ring[b->count % BATCH_WINDOW] = *job;
+    b->count++;
+    pthread_cond_signal(&b->queued);
+    pthread_cond_signal(&b->ready);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static int name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Every regular, non-hidden file of the directory, by name. */
+static bool collect_dir(Batch *b, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return false;
+    char **names = NULL;
+    int count = 0, cap = 0;
+    bool ok = true;
+    struct dirent *ent;
+    char path[4096];
+    while (ok && (ent = readdir(d))) {
+        struct stat st;
+        if (ent->d_name[0] == '.') continue;
+        snprintf(path, sizeof path, "%s/%s", dir, ent->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (count == cap) {
+            cap = cap ? 2 * cap : 64;
+            char **grown = realloc(names, cap * sizeof *names);
+            if (!grown) { ok = false; break; }
+            names = grown;
+        }
+        ok = (names[count] = strdup(ent->d_name)) != NULL;
+        count += ok;
+    }
+    closedir(d);
+    if (count) qsort(names, count, sizeof *names, name_cmp);
+
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof path, "%s/%s", dir, names[i]);
+        Job job = {.name = names[i], .path = ok ? strdup(path) : NULL};
+        if (!job.path) {
+            ok = false;
+            free(names[i]);
+            continue;
+        }
+        add_job(b, &job);
+    }
+    free(names);
+    return ok;
+}
+
+/* Split a stream on "--- NAME" lines; edges before the first marker
+ * form a graph of their own. Each graph goes to the workers as soon as
+ * the next marker or the end of the stream closes it. */
+static bool collect_stream(Batch *b, FILE *fp) {
+    char *line = NULL, name[64];
+    size_t line_cap = 0;
+    ssize_t len;
+    FILE *chunk = NULL;
+    Job job = {0};
+    int graphs = 0;
+    bool ok = true;
+    while (ok && (len = getline(&line, &line_cap, fp)) >= 0) {
+        bool marker = strncmp(line, "---", 3) == 0;
+        if (!marker && !chunk) {
+            /* comments and blank lines ahead of the first marker */
+            char *p = line + strspn(line, " \t");
+            if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        }
+        if (marker || !chunk) {
+            if (chunk) {
+                fclose(chunk);
+                chunk = NULL;
+                add_job(b, &job);
+            }
+            char *p = line + (marker ? 3 : 0);
+            while (*p == '-' || *p == ' ' || *p == '\t') p++;
+            p[strcspn(p, "\r\n")] = '\0';
+            if (!marker || !*p) {
+                snprintf(name, sizeof name, "graph%04d", graphs + 1);
+                p = name;
+            }
+            graphs++;
+            job = (Job){.name = strdup(p)};
+            chunk = job.name ? open_memstream(&job.text, &job.text_len)
+                             : NULL;
+            ok = chunk != NULL;
+            if (marker) continue;
+        }
+        if (ok) fwrite(line, 1, len, chunk);
+    }
+    if (chunk) {
+        fclose(chunk);
+        add_job(b, &job);
+    } else {
+        free(job.name);
+    }
+    free(line);
+    return ok;
+}
+
+/* Reader thread: feeds the jobs in input order, then marks the end. */
+static void *reader(void *arg) {
+    Batch *b = arg;
+    const char *input = b->input;
+    struct stat st;
+    bool ok;
+    if (strcmp(input, "-") != 0 && stat(input, &st) == 0
+        && S_ISDIR(st.st_mode)) {
+        ok = collect_dir(b, input);
+    } else {
+        FILE *fp = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+        ok = fp && collect_stream(b, fp);
+        if (fp && fp != stdin) fclose(fp);
+    }
+    if (!ok) perror(input);
+
+    pthread_mutex_lock(&b->lock);
+    b->input_done = true;
+    b->input_ok = ok;
+    pthread_cond_broadcast(&b->queued);
+    pthread_cond_broadcast(&b->ready);
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+/* ---- workers ---- */
+
+static void render_job(const BatchOptions *opt, Job *job, Scratch *s) {
+    if (!s) { job->error = "Out of memory"; return; }
+    FILE *in = job->path ? fopen(job->path, "r")
+             : job->text_len ? fmemopen(job->text, job->text_len, "r")
+             : NULL;
+    int edge_count = 0;
+    if (in) {
+        edge_count = read_graph(in, opt->format, &s->g);
+        fclose(in);
+    } else if (job->path) {
+        job->error = "Cannot open";
+        return;
+    }
+    if (edge_count == 0) { job->error = "No edges"; return; }
+
+    if (opt->reduce) graph_transitive_reduce(&s->g);
+
+    Arena arena;
+    arena_init(&arena, sugiyama_arena_size(&s->g), NULL);
+    Layout layout;
+    if (!sugiyama(&arena, &s->g, NULL, NULL, &layout)) {
+        arena_free(&arena);
+        job->error = "Out of memory";
+        return;
+    }
+    memset(&s->cv, 0, sizeof s->cv);
+    build_canvas(&s->cv, &arena, &s->g, &layout,
+                 canvas_compute_width(&s->g, &layout, opt->max_width));
+
+    FILE *out = open_memstream(&job->out, &job->out_len);
+    if (out) {
+        canvas_print(&s->cv, out);
+        fclose(out);
+    } else {
+        job->error = "Out of memory";
+    }
+    canvas_free(&s->cv);
+    arena_free(&arena);
+}
+
+static void *worker(void *arg) {
+    Batch *b = arg;
+    Scratch *s = malloc(sizeof *s);
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        while (b->next == b->count && !b->input_done)
+            pthread_cond_wait(&b->queued, &b->lock);
+        int i = b->next < b->count ? b->next++ : -1;
+        pthread_mutex_unlock(&b->lock);
+        if (i < 0) break;
+        Job *job = &b->ring[i % BATCH_WINDOW];
+
+        render_job(b->opt, job, s);
+
+        pthread_mutex_lock(&b->lock);
+        job->done = true;
+        pthread_cond_broadcast(&b->ready);
+        pthread_mutex_unlock(&b->lock);
+    }
+    free(s);
+    return NULL;
+}
+
+/* Output goes to stdout behind "--- NAME" lines, or to OUT_DIR/NAME. */
+static bool write_job(const BatchOptions *opt, const Job *job) {
+    if (!opt->out_dir) {
+        printf("--- %s\n", job->name);
+        fwrite(job->out, 1, job->out_len, stdout);
+        fflush(stdout);     /* readers of a pipe see each graph at once */
+        return true;
+    }
+    char path[4096];
+    int n = snprintf(path, sizeof path, "%s/", opt->out_dir);
+    for (const char *p = job->name; *p && n < (int)sizeof path - 1; p++)
+        path[n++] = *p == '/' ? '_' : *p;
+    path[n] = '\0';
+    FILE *fp = fopen(path, "w");
+    if (!fp) { perror(path); return false; }
+    fwrite(job->out, 1, job->out_len, fp);
+    fclose(fp);
+    return true;
+}
+
+/* ---- public API ---- */
+
+/*
+ * Lay out every graph of a directory of edge files, or of one stream
+ * split by marker lines, on a pool of worker threads. A reader thread
+ * feeds them while the caller writes results in input order as they
+ * become ready. Returns the exit status.
+ */
+int batch_run(const char *input, const BatchOptions *opt) {
+    Batch *b = calloc(1, sizeof *b);
+    int jobs = opt->jobs > 0 ? opt->jobs
+                             : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    pthread_t *threads = malloc(jobs * sizeof *threads), feeder;
+    if (!b || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        free(b);
+        free(threads);
+        return 1;
+    }
+    b->opt = opt;
+    b->input = input;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->queued, NULL);
+    pthread_cond_init(&b->ready, NULL);
+    pthread_cond_init(&b->room, NULL);
+
+    int started = 0;
+    while (started < jobs
+           && pthread_create(&threads[started], NULL, worker, b) == 0)
+        started++;
+    if (started == 0 || pthread_create(&feeder, NULL, reader, b) != 0) {
+        fprintf(stderr, "Cannot start worker threads\n");
+        /* wake any workers so they can be joined */
+        pthread_mutex_lock(&b->lock);
+        b->input_done = true;
+        pthread_cond_broadcast(&b->queued);
+        pthread_mutex_unlock(&b->lock);
+        for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+        free(threads);
+        free(b);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 0;; i++) {
+        Job *job = &b->ring[i % BATCH_WINDOW];
+        pthread_mutex_lock(&b->lock);
+        while (!(i < b->count && job->done)
+               && !(i == b->count && b->input_done))
+            pthread_cond_wait(&b->ready, &b->lock);
+        bool end = i == b->count;
+        pthread_mutex_unlock(&b->lock);
+        if (end) break;
+
+        if (job->error) {
+            fprintf(stderr, "%s: %s\n", job->name, job->error);
+            status = 1;
+        } else if (!write_job(opt, job)) {
+            status = 1;
+        }
+        free(job->name); free(job->path);
+        free(job->text); free(job->out);
+
+        pthread_mutex_lock(&b->lock);
+        b->written = i + 1;
+        pthread_cond_signal(&b->room);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    pthread_join(feeder, NULL);
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    if (!b->input_ok) status = 1;
+    free(threads);
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->queued);
+    pthread_cond_destroy(&b->ready);
+    pthread_cond_destroy(&b->room);
+    free(b);
+    return status;
+}
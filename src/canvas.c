@@ -15,151 +15,465 @@ const wchar_t CONNECTOR[16] = {
 
 /* ---- helpers ---- */
 
-static void path_push(Canvas *cv, int row, int col) {
-    if (cv->ptotal >= cv->pcap) {
-        int new_cap = cv->pcap ? cv->pcap * 2 : 8192;
-        int *new_pr = realloc(cv->pr, new_cap * sizeof *cv->pr);
-        if (!new_pr) return;
-        cv->pr = new_pr;
-        int *new_pc = realloc(cv->pc, new_cap * sizeof *cv->pc);
-        if (!new_pc) return;
-        cv->pc = new_pc;
-        cv->pcap = new_cap;
-    }
-    cv->pr[cv->ptotal] = row;
-    cv->pc[cv->ptotal] = col;
-    cv->ptotal++;
+static int clamp(int v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : v;
 }
 
-static void add_dir(Canvas *cv, int x, int y, uint8_t d) {
-    if (y >= 0 && y < cv->height && x >= 0 && x < cv->width)
-        cv->dirs[y * cv->width + x] |= d;
+static void add_seg(Canvas *cv, int edge, int x0, int y0, int x1, int y1) {
+    Seg *s = &cv->segs[cv->seg_count++];
+    s->x0 = x0; s->y0 = y0;
+    s->x1 = x1; s->y1 = y1;
+    s->edge = edge;
 }
 
-static void draw_vline(Canvas *cv, int x, int y0, int y1) {
-    int s = (y1 > y0) ? 1 : -1;
-    int y = y0;
-    while (y != y1) {
-        add_dir(cv, x, y, s > 0 ? DIR_S : DIR_N);
-        path_push(cv, y, x);
-        y += s;
-        add_dir(cv, x, y, s > 0 ? DIR_N : DIR_S);
-    }
-    path_push(cv, y1, x);
+/* Label width, counting the elided-edge markers of focus boundary nodes. */
+static int label_len(const Node *node) {
+    return (int)strlen(node->name) + node->elided_in + node->elided_out;
 }
 
-static void draw_hline(Canvas *cv, int y, int x0, int x1) {
-    int s = (x1 > x0) ? 1 : -1;
-    int x = x0;
-    while (x != x1) {
-        add_dir(cv, x, y, s > 0 ? DIR_E : DIR_W);
-        path_push(cv, y, x);
-        x += s;
-        add_dir(cv, x, y, s > 0 ? DIR_W : DIR_E);
-    }
-    path_push(cv, y, x1);
+static wchar_t label_char(const Node *node, int i) {
+    if (node->elided_in && i-- == 0) return ELIDED_IN;
+    if (i < (int)strlen(node->name)) return (wchar_t)node->name[i];
+    return ELIDED_OUT;
+}
+
+/* Columns given to each node: the widest label plus a gap. */
+static int node_spacing(const Graph *g) {
+    int max_label = 1;
+    for (int i = 0; i < g->count; i++)
+        if (g->nodes[i].active) {
+            int len = label_len(&g->nodes[i]);
+            if (len > max_label) max_label = len;
+        }
+    int cols_per_node = max_label + 2;
+    if (cols_per_node < MIN_COLS_NODE) cols_per_node = MIN_COLS_NODE;
+    return cols_per_node;
+}
+
+/* Sub-rows a level is folded into when it holds more than row_cap items. */
+static int level_rows(const Canvas *cv, const NodeList *level) {
+    if (level->count <= cv->row_cap) return 1;
+    return (level->count + cv->row_cap - 1) / cv->row_cap;
+}
+
+/* Column of the gap between two cells of a folded row nearest to col.
+ * Labels in folded rows are narrower than a cell, so gaps stay clear. */
+static int gap_col(const Canvas *cv, int col) {
+    double cell = (cv->width - 1) / (double)cv->row_cap;
+    int k = clamp((int)round(col / cell), 0, cv->row_cap);
+    return (int)round(k * cell);
+}
+
+/* Tile span of a segment or label, clipped to the tile grid. */
+static void tile_span(const Canvas *cv, int x0, int y0, int x1, int y1,
+                      int *tx0, int *ty0, int *tx1, int *ty1) {
+    if (x0 > x1) { int swap = x0; x0 = x1; x1 = swap; }
+    if (y0 > y1) { int swap = y0; y0 = y1; y1 = swap; }
+    *tx0 = clamp(x0 / TILE_W, 0, cv->tiles_x - 1);
+    *tx1 = clamp(x1 / TILE_W, 0, cv->tiles_x - 1);
+    *ty0 = clamp(y0 / TILE_H, 0, cv->tiles_y - 1);
+    *ty1 = clamp(y1 / TILE_H, 0, cv->tiles_y - 1);
 }
 
 /* ---- internal steps ---- */
 
-static void canvas_place_nodes(Canvas *cv, const NodeList *levels,
-                               int level_count) {
-    for (int lvl = 0; lvl < level_count; lvl++) {
-        int nodes_in_level = levels[lvl].count;
+/* Levels wider than row_cap wrap onto extra sub-rows, every sub-row laid
+ * out on the same row_cap cells so that the gaps line up vertically. */
+static void canvas_place_nodes(Canvas *cv, const Layout *lay) {
+    int level_row = 0;
+    for (int lvl = 0; lvl < lay->level_count; lvl++) {
+        const NodeList *level = &lay->levels[lvl];
+        int nodes_in_level = level->count;
         if (nodes_in_level == 0) nodes_in_level = 1;
-        for (int ni = 0; ni < levels[lvl].count; ni++) {
-            int node = levels[lvl].items[ni];
-            cv->node_col[node] = (int)round(
-                (ni + 0.5) / (double)nodes_in_level * (cv->width - 1));
-            cv->node_row[node] = VERT_SPACING * lvl;
+        bool folded = level_rows(cv, level) > 1;
+        for (int ni = 0; ni < level->count; ni++) {
+            int item = level->items[ni];
+            int cell = folded ? ni % cv->row_cap : ni;
+            int cells = folded ? cv->row_cap : nodes_in_level;
+            int col = (int)round(
+                (cell + 0.5) / (double)cells * (cv->width - 1));
+            int row = level_row
+                      + (folded ? VERT_SPACING * (ni / cv->row_cap) : 0);
+            if (IS_SLOT(item)) {
+                cv->slot_col[ITEM_SLOT(item)] = col;
+                cv->slot_row[ITEM_SLOT(item)] = row;
+            } else {
+                cv->node_col[item] = col;
+                cv->node_row[item] = row;
+            }
         }
+        level_row += VERT_SPACING * level_rows(cv, level);
     }
 }
 
-static void canvas_route_edges(Canvas *cv, const Graph *g) {
-    cv->pr = NULL; cv->pc = NULL;
-    cv->ptotal = cv->pcap = 0;
-    cv->ep_count = 0;
+/*
+ * One level-to-level hop: down to the edge row, across, then to dst. When
+ * folded sub-rows lie between the two ends, the hop drops through the gap
+ * column nearest the lower end and crosses over just above it.
+ */
+static void route_hop(Canvas *cv, int edge, int src_col, int src_row,
+                      int dst_col, int dst_row) {
+    if (abs(dst_row - src_row) > VERT_SPACING) {
+        bool down = src_row < dst_row;
+        int top_col = down ? src_col : dst_col;
+        int top_row = down ? src_row : dst_row;
+        int bot_col = down ? dst_col : src_col;
+        int bot_row = down ? dst_row : src_row;
+        int lane = gap_col(cv, bot_col);
+        int exit_row = top_row + EDGE_V_OFFSET;
+        int entry_row = bot_row - VERT_SPACING + EDGE_V_OFFSET;
+        add_seg(cv, edge, top_col, top_row, top_col, exit_row);
+        add_seg(cv, edge, top_col, exit_row, lane, exit_row);
+        add_seg(cv, edge, lane, exit_row, lane, entry_row);
+        add_seg(cv, edge, lane, entry_row, bot_col, entry_row);
+        add_seg(cv, edge, bot_col, entry_row, bot_col, bot_row);
+        return;
+    }
+    int edge_row = src_row + EDGE_V_OFFSET;
+    add_seg(cv, edge, src_col, src_row, src_col, edge_row);
+    add_seg(cv, edge, src_col, edge_row, dst_col, edge_row);
+    add_seg(cv, edge, dst_col, edge_row, dst_col, dst_row);
+}
+
+static int begin_edge(Canvas *cv, int src, int dst) {
+    int edge_idx = cv->ep_count++;
+    cv->ep_src[edge_idx] = src;
+    cv->ep_dst[edge_idx] = dst;
+    cv->ep_off[edge_idx] = cv->seg_count;
+    return edge_idx;
+}
 
+static void end_edge(Canvas *cv, int edge_idx) {
+    cv->ep_len[edge_idx] = cv->seg_count - cv->ep_off[edge_idx];
+}
+
+static void canvas_route_edges(Canvas *cv, const Graph *g, const Layout *lay) {
     for (int i = 0; i < g->count; i++) {
         if (!g->nodes[i].active) continue;
-        int src_col = cv->node_col[i], src_row = cv->node_row[i];
-        int edge_row = src_row + EDGE_V_OFFSET;
         for (int j = 0; j < g->nodes[i].out_count; j++) {
             int dst = g->nodes[i].adj_out[j];
-            int dst_col = cv->node_col[dst], dst_row = cv->node_row[dst];
-            int path_offset = cv->ptotal;
-            draw_vline(cv, src_col, src_row, edge_row);
-            draw_hline(cv, edge_row, src_col, dst_col);
-            draw_vline(cv, dst_col, edge_row, dst_row);
-            if (cv->ep_count < MAX_EDGES) {
-                int edge_idx = cv->ep_count++;
-                cv->ep_src[edge_idx] = i;
-                cv->ep_dst[edge_idx] = dst;
-                cv->ep_off[edge_idx] = path_offset;
-                cv->ep_len[edge_idx] = cv->ptotal - path_offset;
-            }
+            /* long edges are routed through their chain below */
+            if (abs(lay->node_level[dst] - lay->node_level[i]) > 1) continue;
+            int edge = begin_edge(cv, i, dst);
+            route_hop(cv, edge, cv->node_col[i], cv->node_row[i],
+                      cv->node_col[dst], cv->node_row[dst]);
+            end_edge(cv, edge);
         }
     }
-}
 
-static void canvas_stamp_glyphs(Canvas *cv, const Graph *g) {
-    for (int i = 0; i < cv->height * cv->width; i++)
-        cv->cells[i] = CONNECTOR[cv->dirs[i]];
+    for (int c = 0; c < lay->chain_count; c++) {
+        const Chain *chain = &lay->chains[c];
+        int edge = begin_edge(cv, chain->src, chain->dst);
+        int col = cv->node_col[chain->src], row = cv->node_row[chain->src];
+        for (int k = 0; k < chain->len; k++) {
+            int slot = chain->first + k;
+            route_hop(cv, edge, col, row,
+                      cv->slot_col[slot], cv->slot_row[slot]);
+            col = cv->slot_col[slot];
+            row = cv->slot_row[slot];
+        }
+        route_hop(cv, edge, col, row,
+                  cv->node_col[chain->dst], cv->node_row[chain->dst]);
+        end_edge(cv, edge);
+    }
+}
 
-    memset(cv->has_bnd, 0, sizeof cv->has_bnd);
+static void canvas_place_labels(Canvas *cv, const Graph *g) {
     for (int i = 0; i < g->count; i++) {
-        if (!g->nodes[i].active || g->nodes[i].is_dummy) continue;
-        int col = cv->node_col[i], row = cv->node_row[i];
-        int label_len = (int)strlen(g->nodes[i].name);
-        int label_start = col - label_len / 2;
-        for (int c = 0; c < label_len; c++) {
-            int x = label_start + c;
-            if (x >= 0 && x < cv->width)
-                cv->cells[row * cv->width + x] =
-                    (wchar_t)g->nodes[i].name[c];
-        }
+        if (!g->nodes[i].active) continue;
+        int len = label_len(&g->nodes[i]);
+        int label_start = cv->node_col[i] - len / 2;
         cv->bnd_xs[i] = label_start;
-        cv->bnd_xe[i] = label_start + label_len - 1;
-        cv->bnd_y[i]  = row;
+        cv->bnd_xe[i] = label_start + len - 1;
+        cv->bnd_y[i]  = cv->node_row[i];
         cv->has_bnd[i] = true;
     }
 }
 
-/* ---- public API ---- */
+/* Bucket segments and labels by the tiles they touch (two-pass CSR). */
+static bool canvas_index_tiles(Canvas *cv, Arena *a) {
+    int tiles = cv->tiles_x * cv->tiles_y;
+    cv->tile_seg_off = arena_alloc(a, (tiles + 1) * sizeof(int));
+    cv->tile_node_off = arena_alloc(a, (tiles + 1) * sizeof(int));
+    int *fill = arena_alloc(a, tiles * sizeof(int));
+    if (!cv->tile_seg_off || !cv->tile_node_off || !fill) return false;
 
-int canvas_compute_width(const Graph *g, const NodeList *levels,
-                         int level_count) {
-    int max_label = 1;
-    for (int i = 0; i < g->count; i++)
-        if (g->nodes[i].active && !g->nodes[i].is_dummy) {
-            int len = (int)strlen(g->nodes[i].name);
-            if (len > max_label) max_label = len;
+    int tx0, ty0, tx1, ty1;
+    for (int pass = 0; pass < 2; pass++) {
+        int *off = pass ? cv->tile_node_off : cv->tile_seg_off;
+        int items = pass ? cv->g->count : cv->seg_count;
+        for (int i = 0; i < items; i++) {
+            if (pass) {
+                if (!cv->has_bnd[i]) continue;
+                tile_span(cv, cv->bnd_xs[i], cv->bnd_y[i],
+                          cv->bnd_xe[i], cv->bnd_y[i], &tx0, &ty0, &tx1, &ty1);
+            } else {
+                const Seg *s = &cv->segs[i];
+                tile_span(cv, s->x0, s->y0, s->x1, s->y1,
+                          &tx0, &ty0, &tx1, &ty1);
+            }
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++)
+                    off[ty * cv->tiles_x + tx + 1]++;
         }
-    int cols_per_node = max_label + 2;
-    if (cols_per_node < MIN_COLS_NODE) cols_per_node = MIN_COLS_NODE;
+        for (int t = 0; t < tiles; t++) off[t + 1] += off[t];
+
+        int *list = arena_alloc(a, (off[tiles] + 1) * sizeof(int));
+        if (!list) return false;
+        memset(fill, 0, tiles * sizeof *fill);
+        for (int i = 0; i < items; i++) {
+            if (pass) {
+                if (!cv->has_bnd[i]) continue;
+                tile_span(cv, cv->bnd_xs[i], cv->bnd_y[i],
+                          cv->bnd_xe[i], cv->bnd_y[i], &tx0, &ty0, &tx1, &ty1);
+            } else {
+                const Seg *s = &cv->segs[i];
+                tile_span(cv, s->x0, s->y0, s->x1, s->y1,
+                          &tx0, &ty0, &tx1, &ty1);
+            }
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++) {
+                    int t = ty * cv->tiles_x + tx;
+                    list[off[t] + fill[t]++] = i;
+                }
+        }
+        if (pass) cv->tile_node = list;
+        else      cv->tile_seg = list;
+    }
+    return true;
+}
+
+/* ---- rasterisation ---- */
+
+/* Draw the part of a segment inside the w x h rectangle at (x0, y0). */
+static void raster_seg(const Canvas *cv, const Seg *s, int x0, int y0,
+                       int w, int h, uint8_t *dirs, bool *highlight) {
+    bool lit = cv->ep_hl[s->edge];
+    bool vertical = s->x0 == s->x1;
+    int lo = vertical ? s->y0 : s->x0, hi = vertical ? s->y1 : s->x1;
+    if (lo > hi) { int swap = lo; lo = hi; hi = swap; }
+    uint8_t fwd = vertical ? DIR_S : DIR_E, back = vertical ? DIR_N : DIR_W;
+
+    int fixed = vertical ? s->x0 - x0 : s->y0 - y0;
+    int origin = vertical ? y0 : x0, span = vertical ? h : w;
+    if (fixed < 0 || fixed >= (vertical ? w : h)) return;
+    for (int v = (lo > origin ? lo : origin);
+         v <= hi && v < origin + span; v++) {
+        int idx = vertical ? (v - y0) * w + fixed : fixed * w + (v - x0);
+        if (v < hi) dirs[idx] |= fwd;
+        if (v > lo) dirs[idx] |= back;
+        if (lit) highlight[idx] = true;
+    }
+}
+
+static void raster_label(const Canvas *cv, int node, int x0, int y0,
+                         int w, int h, wchar_t *cells, bool *highlight) {
+    int row = cv->bnd_y[node] - y0;
+    if (row < 0 || row >= h) return;
+    const Node *n = &cv->g->nodes[node];
+    for (int x = cv->bnd_xs[node]; x <= cv->bnd_xe[node]; x++) {
+        if (x < 0 || x >= cv->width || x < x0 || x >= x0 + w) continue;
+        cells[row * w + x - x0] = label_char(n, x - cv->bnd_xs[node]);
+        if (cv->node_hl[node]) highlight[row * w + x - x0] = true;
+    }
+}
+
+/* Rasterise a rectangle aligned to tile boundaries; dirs is scratch. */
+static void raster_rect(const Canvas *cv, int x0, int y0, int w, int h,
+                        wchar_t *cells, bool *highlight, uint8_t *dirs) {
+    memset(dirs, 0, (size_t)w * h * sizeof *dirs);
+    memset(highlight, 0, (size_t)w * h * sizeof *highlight);
+
+    int tx0, ty0, tx1, ty1;
+    tile_span(cv, x0, y0, x0 + w - 1, y0 + h - 1, &tx0, &ty0, &tx1, &ty1);
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++) {
+            int t = ty * cv->tiles_x + tx;
+            for (int i = cv->tile_seg_off[t]; i < cv->tile_seg_off[t + 1]; i++)
+                raster_seg(cv, &cv->segs[cv->tile_seg[i]], x0, y0, w, h,
+                           dirs, highlight);
+        }
+    for (int i = 0; i < w * h; i++) cells[i] = CONNECTOR[dirs[i]];
+
+    /* labels go on top, in node order, so later nodes win overlaps */
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++) {
+            int t = ty * cv->tiles_x + tx;
+            for (int i = cv->tile_node_off[t]; i < cv->tile_node_off[t + 1]; i++)
+                raster_label(cv, cv->tile_node[i], x0, y0, w, h,
+                             cells, highlight);
+        }
+}
+
+static const Tile *canvas_tile(Canvas *cv, int tx, int ty) {
+    int key = ty * cv->tiles_x + tx;
+    int slot = cv->tile_slot[key];
+    if (slot < 0) {
+        /* evict the least recently used tile */
+        slot = 0;
+        for (int i = 1; i < TILE_CACHE; i++)
+            if (cv->cache[i].used < cv->cache[slot].used) slot = i;
+        if (cv->cache[slot].key >= 0)
+            cv->tile_slot[cv->cache[slot].key] = -1;
+        cv->cache[slot].key = key;
+        cv->cache[slot].gen = cv->hl_gen - 1;
+        cv->tile_slot[key] = slot;
+    }
+    Tile *tile = &cv->cache[slot];
+    if (tile->gen != cv->hl_gen) {
+        uint8_t dirs[TILE_W * TILE_H];
+        raster_rect(cv, tx * TILE_W, ty * TILE_H, TILE_W, TILE_H,
+                    tile->cells, tile->highlight, dirs);
+        tile->gen = cv->hl_gen;
+    }
+    tile->used = ++cv->tick;
+    return tile;
+}
+
+/* ---- public API ---- */
+
+/* A positive max_width caps the width; build_canvas then folds the levels
+ * that no longer fit into several sub-rows. */
+int canvas_compute_width(const Graph *g, const Layout *lay, int max_width) {
+    int cols_per_node = node_spacing(g);
     int max_level_size = 1;
-    for (int i = 0; i < level_count; i++)
-        if (levels[i].count > max_level_size)
-            max_level_size = levels[i].count;
+    for (int i = 0; i < lay->level_count; i++)
+        if (lay->levels[i].count > max_level_size)
+            max_level_size = lay->levels[i].count;
+    if (max_width > 0) {
+        int fit = (max_width - CANVAS_MARGIN) / cols_per_node;
+        if (fit < 1) fit = 1;
+        if (max_level_size > fit) max_level_size = fit;
+    }
     return cols_per_node * max_level_size + CANVAS_MARGIN;
 }
 
-void build_canvas(Canvas *cv, const Graph *g,
-                  const NodeList *levels, int level_count, int canvas_width) {
+/* Place nodes and route edges, without anything needed to draw them. */
+bool canvas_place(Canvas *cv, Arena *a, const Graph *g, const Layout *lay,
+                  int canvas_width) {
+    cv->g = g;
     cv->width = canvas_width;
-    cv->height = VERT_SPACING * level_count + CANVAS_MARGIN;
-    cv->cells = calloc(cv->height * cv->width, sizeof *cv->cells);
-    cv->dirs  = calloc(cv->height * cv->width, sizeof *cv->dirs);
-    if (!cv->cells || !cv->dirs) return;
-    for (int i = 0; i < cv->height * cv->width; i++) cv->cells[i] = L' ';
+    cv->row_cap = (canvas_width - CANVAS_MARGIN) / node_spacing(g);
+    if (cv->row_cap < 1) cv->row_cap = 1;
+    int rows = 0;
+    for (int lvl = 0; lvl < lay->level_count; lvl++)
+        rows += level_rows(cv, &lay->levels[lvl]);
+    cv->height = VERT_SPACING * rows + CANVAS_MARGIN;
+    cv->seg_count = cv->ep_count = 0;
+
+    int edge_count = 0, hop_count = 0;
+    for (int i = 0; i < g->count; i++) edge_count += g->nodes[i].out_count;
+    hop_count = edge_count;
+    for (int c = 0; c < lay->chain_count; c++) hop_count += lay->chains[c].len;
+
+    cv->slot_col = arena_alloc(a, (lay->slot_count + 1) * sizeof(int));
+    cv->slot_row = arena_alloc(a, (lay->slot_count + 1) * sizeof(int));
+    /* at most five segments per hop, see route_hop */
+    cv->segs = arena_alloc(a, (5 * hop_count + 1) * sizeof *cv->segs);
+    cv->ep_src = arena_alloc(a, (edge_count + 1) * sizeof(int));
+    cv->ep_dst = arena_alloc(a, (edge_count + 1) * sizeof(int));
+    cv->ep_off = arena_alloc(a, (edge_count + 1) * sizeof(int));
+    cv->ep_len = arena_alloc(a, (edge_count + 1) * sizeof(int));
+    cv->ep_hl = arena_alloc(a, (edge_count + 1) * sizeof(bool));
+    cv->ep_lit = arena_alloc(a, (edge_count + 1) * sizeof(int));
+    cv->ep_lit_count = cv->node_lit_count = 0;
+    if (!cv->slot_col || !cv->slot_row || !cv->segs || !cv->ep_src
+        || !cv->ep_dst || !cv->ep_off || !cv->ep_len || !cv->ep_hl
+        || !cv->ep_lit) {
+        cv->width = cv->height = 0;
+        return false;
+    }
+
+    canvas_place_nodes(cv, lay);
+    canvas_route_edges(cv, g, lay);
+    canvas_place_labels(cv, g);
+    return true;
+}
+
+void build_canvas(Canvas *cv, Arena *a, const Graph *g, const Layout *lay,
+                  int canvas_width) {
+    if (!canvas_place(cv, a, g, lay, canvas_width)) return;
+    cv->tiles_x = (cv->width + TILE_W - 1) / TILE_W;
+    cv->tiles_y = (cv->height + TILE_H - 1) / TILE_H;
+
+    cv->tile_slot = arena_alloc(a, cv->tiles_x * cv->tiles_y * sizeof(int));
+    cv->cache = calloc(TILE_CACHE, sizeof *cv->cache);
+    if (!cv->tile_slot || !cv->cache) {
+        cv->width = cv->height = 0;
+        return;
+    }
+    for (int i = 0; i < cv->tiles_x * cv->tiles_y; i++) cv->tile_slot[i] = -1;
+    for (int i = 0; i < TILE_CACHE; i++) cv->cache[i].key = -1;
+
+    if (!canvas_index_tiles(cv, a)) cv->width = cv->height = 0;
+}
+
+/* Light up the edges and neighbour labels of a node (-1 clears), and list
+ * them in ep_lit / node_lit. Cached tiles are redrawn lazily the next time
+ * they are looked at. */
+void canvas_select(Canvas *cv, int selected) {
+    for (int i = 0; i < cv->node_lit_count; i++)
+        cv->node_hl[cv->node_lit[i]] = false;
+    cv->ep_lit_count = cv->node_lit_count = 0;
+    for (int e = 0; e < cv->ep_count; e++) {
+        int src = cv->ep_src[e], dst = cv->ep_dst[e];
+        cv->ep_hl[e] = selected >= 0 && (src == selected || dst == selected);
+        if (!cv->ep_hl[e]) continue;
+        cv->ep_lit[cv->ep_lit_count++] = e;
+        int other = src == selected ? dst : src;
+        if (!cv->node_hl[other]) {
+            cv->node_hl[other] = true;
+            cv->node_lit[cv->node_lit_count++] = other;
+        }
+    }
+    cv->hl_gen++;
+}
+
+wchar_t canvas_cell(Canvas *cv, int x, int y, bool *highlight) {
+    const Tile *tile = canvas_tile(cv, x / TILE_W, y / TILE_H);
+    int idx = (y % TILE_H) * TILE_W + x % TILE_W;
+    if (highlight) *highlight = tile->highlight[idx];
+    return tile->cells[idx];
+}
+
+/* Plain-text dump, rasterised one full-width strip of tiles at a time. */
+void canvas_print(const Canvas *cv, FILE *fp) {
+    int w = cv->tiles_x * TILE_W;
+    wchar_t *cells = malloc((size_t)w * TILE_H * sizeof *cells);
+    bool *highlight = malloc((size_t)w * TILE_H * sizeof *highlight);
+    uint8_t *dirs = malloc((size_t)w * TILE_H * sizeof *dirs);
+    char *buf = malloc((size_t)cv->width * MB_CUR_MAX + 1);
+    if (!cells || !highlight || !dirs || !buf) goto done;
+
+    for (int y0 = 0; y0 < cv->height; y0 += TILE_H) {
+        raster_rect(cv, 0, y0, w, TILE_H, cells, highlight, dirs);
+        for (int row = y0; row < y0 + TILE_H && row < cv->height; row++) {
+            mbstate_t state;
+            memset(&state, 0, sizeof state);
+            size_t len = 0;
+            for (int col = 0; col < cv->width; col++) {
+                size_t n = wcrtomb(buf + len, cells[(row - y0) * w + col],
+                                   &state);
+                if (n == (size_t)-1) {
+                    memset(&state, 0, sizeof state);
+                    buf[len] = '?';
+                    n = 1;
+                }
+                len += n;
+            }
+            /* trim trailing spaces */
+            while (len > 0 && buf[len - 1] == ' ') len--;
+            buf[len] = '\0';
+            fputs(buf, fp);
+            fputc('\n', fp);
+        }
+    }
 
-    canvas_place_nodes(cv, levels, level_count);
-    canvas_route_edges(cv, g);
-    canvas_stamp_glyphs(cv, g);
+done:
+    free(cells); free(highlight); free(dirs); free(buf);
 }
 
 void canvas_free(Canvas *cv) {
-    free(cv->cells); free(cv->dirs);
-    free(cv->pr);    free(cv->pc);
+    free(cv->cache);
+    cv->cache = NULL;
 }
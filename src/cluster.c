@@ -0,0 +1,163 @@
+#include "drawdag.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- helpers ---- */
+
+static int cluster_find_or_add(Clusters *cl, const char *key) {
+    for (int c = 0; c < cl->count; c++)
+        if (strcmp(cl->key[c], key) == 0) return c;
+    if (cl->count >= MAX_NODES) return -1;
+    int c = cl->count++;
+    snprintf(cl->key[c], MAX_NAME, "%s", key);
+    cl->size[c] = 0;
+    cl->expanded[c] = false;
+    return c;
+}
+
+static void cluster_assign(Clusters *cl, int node, const char *key) {
+    if (cl->group[node] >= 0) return;
+    int c = cluster_find_or_add(cl, key);
+    if (c < 0) return;
+    cl->group[node] = c;
+    cl->size[c]++;
+}
+
+/* A cluster is drawn as one node only when it has several members. */
+static bool collapsed(const Clusters *cl, int c) {
+    return c >= 0 && cl->size[c] > 1 && !cl->expanded[c];
+}
+
+/* ---- grouping ---- */
+
+void cluster_init(Clusters *cl, const Graph *g) {
+    cl->count = 0;
+    for (int i = 0; i < g->count; i++) cl->group[i] = -1;
+}
+
+/* Group by the name up to and including the first delimiter ("test/"). */
+void cluster_by_delim(Clusters *cl, const Graph *g, char delim) {
+    for (int i = 0; i < g->count; i++) {
+        const char *name = g->nodes[i].name;
+        const char *cut = strchr(name, delim);
+        if (!cut || cut == name) continue;
+        char key[MAX_NAME];
+        snprintf(key, sizeof key, "%.*s", (int)(cut - name + 1), name);
+        cluster_assign(cl, i, key);
+    }
+}
+
+void cluster_by_prefix(Clusters *cl, const Graph *g, const char *prefix) {
+    size_t len = strlen(prefix);
+    for (int i = 0; i < g->count; i++)
+        if (strncmp(g->nodes[i].name, prefix, len) == 0)
+            cluster_assign(cl, i, prefix);
+}
+
+/* Explicit grouping, one "NODE GROUP" pair per line; returns pairs used. */
+int cluster_read(Clusters *cl, const Graph *g, FILE *fp) {
+    int n = 0;
+    char line[256], node[MAX_NAME], group[MAX_NAME];
+    while (fgets(line, sizeof line, fp)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        if (sscanf(p, "%63s %63s", node, group) != 2) continue;
+        int idx = graph_find(g, node);
+        if (idx < 0) continue;
+        cluster_assign(cl, idx, group);
+        n++;
+    }
+    return n;
+}
+
+/* ---- views ---- */
+
+/*
+ * Build the graph actually laid out: every collapsed cluster becomes one
+ * node, edges inside it disappear and edges crossing it are merged.
+ * origin[k] is the base node behind view node k, or CLUSTER_ITEM(c).
+ */
+void cluster_collapse(const Clusters *cl, const Graph *g, Graph *out,
+                      int *origin) {
+    int map[MAX_NODES], cluster_node[MAX_NODES];
+    for (int c = 0; c < cl->count; c++) cluster_node[c] = -1;
+    graph_init(out);
+
+    for (int i = 0; i < g->count; i++) {
+        int c = cl->group[i];
+        if (!collapsed(cl, c)) {
+            map[i] = graph_add(out, g->nodes[i].name);
+            origin[map[i]] = i;
+        } else {
+            if (cluster_node[c] < 0) {
+                char label[MAX_NAME];
+                snprintf(label, sizeof label, "[%.*s %d]", MAX_NAME - 16,
+                         cl->key[c], cl->size[c]);
+                cluster_node[c] = graph_add(out, label);
+                origin[cluster_node[c]] = CLUSTER_ITEM(c);
+            }
+            map[i] = cluster_node[c];
+        }
+        out->nodes[map[i]].elided_in  |= g->nodes[i].elided_in;
+        out->nodes[map[i]].elided_out |= g->nodes[i].elided_out;
+    }
+    /* a cluster can gather more neighbours than MAX_ADJ; flag the ones
+     * that don't fit like the edges --focus hides */
+    for (int i = 0; i < g->count; i++)
+        for (int j = 0; j < g->nodes[i].out_count; j++) {
+            int src = map[i], dst = map[g->nodes[i].adj_out[j]];
+            if (src == dst || graph_add_edge(out, src, dst)) continue;
+            out->nodes[src].elided_out = true;
+            out->nodes[dst].elided_in = true;
+        }
+}
+
+/* The cluster that view node `node` is or belongs to, or -1. */
+int cluster_of(const Clusters *cl, const int *origin, int node) {
+    return IS_CLUSTER(origin[node]) ? ITEM_CLUSTER(origin[node])
+                                    : cl->group[origin[node]];
+}
+
+/* Expand a collapsed cluster node, or collapse the cluster a node belongs
+ * to. Returns false when the node is not part of any cluster. */
+bool cluster_toggle(Clusters *cl, const int *origin, int node) {
+    int c = cluster_of(cl, origin, node);
+    if (c < 0 || cl->size[c] < 2) return false;
+    cl->expanded[c] = !cl->expanded[c];
+    return true;
+}
+
+/*
+ * Seed the ordering of a new view from the horizontal positions of the
+ * previous one: a node keeps the position of whatever showed it before
+ * (itself or its cluster), and a freshly collapsed cluster takes the mean
+ * of its members. Nodes with no counterpart get -1.
+ */
+void cluster_hints(const Clusters *cl, int base_count,
+                   const int *old_origin, const double *old_pos,
+                   int old_count, const int *origin, int count,
+                   double *hint) {
+    double base_pos[MAX_NODES], cluster_pos[MAX_NODES];
+    for (int c = 0; c < cl->count; c++) cluster_pos[c] = -1;
+    for (int k = 0; k < old_count; k++)
+        if (IS_CLUSTER(old_origin[k]))
+            cluster_pos[ITEM_CLUSTER(old_origin[k])] = old_pos[k];
+    for (int b = 0; b < base_count; b++)
+        base_pos[b] = cl->group[b] >= 0 ? cluster_pos[cl->group[b]] : -1;
+    for (int k = 0; k < old_count; k++)
+        if (!IS_CLUSTER(old_origin[k])) base_pos[old_origin[k]] = old_pos[k];
+
+    for (int k = 0; k < count; k++) {
+        if (!IS_CLUSTER(origin[k])) { hint[k] = base_pos[origin[k]]; continue; }
+        int c = ITEM_CLUSTER(origin[k]), seen = 0;
+        double sum = 0;
+        for (int b = 0; b < base_count; b++)
+            if (cl->group[b] == c && base_pos[b] >= 0) {
+                sum += base_pos[b];
+                seen++;
+            }
+        hint[k] = seen ? sum / seen : -1;
+    }
+}
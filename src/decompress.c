@@ -0,0 +1,209 @@
+#define _GNU_SOURCE             /* F_SETPIPE_SZ */
+#include "drawdag.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define CHUNK   (128 * 1024)    /* decoder buffers and pipe size */
+
+typedef enum { CODEC_GZIP, CODEC_ZSTD } Codec;
+
+/* The decoder thread reads src and writes plain text into a pipe that
+ * the parser reads from, so decoding overlaps with tokenizing. */
+struct Decoder {
+    FILE *src;
+    FILE *out;              /* read end, handed to the parser */
+    int fd;                 /* write end, owned by the thread */
+    Codec codec;
+    char *head;             /* bytes already taken from src */
+    size_t head_len;
+    bool head_done;
+    bool gone;              /* the reader closed its end early */
+    const char *error;
+    pthread_t thread;
+};
+
+/* ---- helpers ---- */
+
+static bool magic(const char *head, size_t len, Codec *codec) {
+    const unsigned char *s = (const unsigned char *)head;
+    if (len >= 2 && s[0] == 0x1f && s[1] == 0x8b) {
+        *codec = CODEC_GZIP;
+        return true;
+    }
+    if (len >= 4 && s[0] == 0x28 && s[1] == 0xb5 && s[2] == 0x2f
+        && s[3] == 0xfd) {
+        *codec = CODEC_ZSTD;
+        return true;
+    }
+    return false;
+}
+
+/* Next piece of compressed input: the sniffed head, then src. */
+static size_t fill(Decoder *d, unsigned char *buf) {
+    if (!d->head_done) {
+        d->head_done = true;
+        memcpy(buf, d->head, d->head_len);
+        return d->head_len;
+    }
+    size_t n = fread(buf, 1, CHUNK, d->src);
+    if (n == 0 && ferror(d->src)) d->error = "Read error in compressed input";
+    return n;
+}
+
+static bool put(Decoder *d, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(d->fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            d->gone = true;
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* ---- codecs ---- */
+
+/* Concatenated members, as written by pigz or cat, are decoded in turn. */
+static bool inflate_gzip(Decoder *d, unsigned char *in, unsigned char *out) {
+    z_stream z;
+    memset(&z, 0, sizeof z);
+    if (inflateInit2(&z, 15 + 16) != Z_OK) return false;
+    int ret = Z_OK;
+    bool ok = true;
+    while (ok && (z.avail_in = fill(d, in)) > 0) {
+        z.next_in = in;
+        do {
+            if (ret == Z_STREAM_END) {
+                if (z.avail_in == 0) break;
+                inflateReset(&z);
+            }
+            z.next_out = out;
+            z.avail_out = CHUNK;
+            ret = inflate(&z, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+            ok = put(d, out, CHUNK - z.avail_out);
+        } while (ok && (z.avail_in > 0 || z.avail_out == 0));
+    }
+    inflateEnd(&z);
+    return ok && ret == Z_STREAM_END;
+}
+
+#ifdef HAVE_ZSTD
+static bool inflate_zstd(Decoder *d, unsigned char *in, unsigned char *out) {
+    ZSTD_DStream *z = ZSTD_createDStream();
+    if (!z) return false;
+    size_t ret = ZSTD_initDStream(z), n;
+    bool ok = !ZSTD_isError(ret);
+    while (ok && (n = fill(d, in)) > 0) {
+        ZSTD_inBuffer zin = {in, n, 0};
+        ZSTD_outBuffer zout;
+        do {
+            zout = (ZSTD_outBuffer){out, CHUNK, 0};
+            ret = ZSTD_decompressStream(z, &zout, &zin);
+            ok = !ZSTD_isError(ret) && put(d, out, zout.pos);
+        } while (ok && (zin.pos < zin.size || zout.pos == zout.size));
+    }
+    ZSTD_freeDStream(z);
+    return ok && ret == 0;      /* 0: the last frame is complete */
+}
+#endif
+
+static void *decode(void *arg) {
+    Decoder *d = arg;
+    /* a reader that stops early must not kill the process */
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    unsigned char *in = malloc(CHUNK), *out = malloc(CHUNK);
+    bool ok = false;
+    if (!in || !out) {
+        d->error = "Out of memory";
+    } else if (d->codec == CODEC_GZIP) {
+        ok = inflate_gzip(d, in, out);
+#ifdef HAVE_ZSTD
+    } else {
+        ok = inflate_zstd(d, in, out);
+#else
+    } else {
+        d->error = "zstd input needs a build with ZSTD=1";
+#endif
+    }
+    if (!ok && !d->gone && !d->error)
+        d->error = "Compressed input is corrupt or truncated";
+    if (d->gone) d->error = NULL;
+    free(in);
+    free(out);
+    close(d->fd);
+    return NULL;
+}
+
+/* ---- public API ---- */
+
+/* Whether the first bytes of an input are gzip or zstd magic. */
+bool decoder_detect(const char *head, size_t len) {
+    Codec codec;
+    return magic(head, len, &codec);
+}
+
+/*
+ * Start decoding src on a thread of its own. head holds the bytes already
+ * read from src, magic included. *out is the plain text stream; it stays
+ * owned by the decoder. Returns NULL if the pipe or thread can't be made.
+ */
+Decoder *decoder_start(FILE *src, const char *head, size_t len, FILE **out) {
+    Decoder *d = calloc(1, sizeof *d);
+    int fds[2] = {-1, -1};
+    if (!d || !(d->head = malloc(len ? len : 1)) || pipe(fds) != 0)
+        goto fail;
+    magic(head, len, &d->codec);
+    memcpy(d->head, head, len);
+    d->head_len = len;
+    d->src = src;
+    d->fd = fds[1];
+#ifdef F_SETPIPE_SZ
+    fcntl(fds[1], F_SETPIPE_SZ, CHUNK);     /* fewer switches; best effort */
+#endif
+    if (!(d->out = fdopen(fds[0], "r"))) goto fail;
+    fds[0] = -1;
+    setvbuf(d->out, NULL, _IOFBF, CHUNK);
+    if (pthread_create(&d->thread, NULL, decode, d) != 0) goto fail;
+    *out = d->out;
+    return d;
+
+fail:
+    if (d && d->out) fclose(d->out);
+    if (fds[0] >= 0) close(fds[0]);
+    if (fds[1] >= 0) close(fds[1]);
+    if (d) free(d->head);
+    free(d);
+    return NULL;
+}
+
+/* Close the plain stream and wait for the thread; NULL, or what went
+ * wrong while decoding. */
+const char *decoder_finish(Decoder *d) {
+    fclose(d->out);
+    pthread_join(d->thread, NULL);
+    const char *error = d->error;
+    free(d->head);
+    free(d);
+    return error;
+}
@@ -10,16 +10,18 @@
 #define _XOPEN_SOURCE_EXTENDED 1
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <wchar.h>
 
+#include "libdrawdag.h"
+
 /* ---- Limits ---- */
 
 #define MAX_NODES       512
 #define MAX_ADJ          64
 #define MAX_NAME         64
-#define MAX_LEVELS      128
 #define MAX_EDGES      4096
 
 /* ---- Layout constants ---- */
@@ -31,6 +33,27 @@
 #define DRAW_MARGIN      1
 #define SCROLL_STEP      VERT_SPACING
 
+/* ---- Lazy canvas tiles ---- */
+
+#define TILE_W          64
+#define TILE_H          24
+#define TILE_CACHE      64
+
+/* ---- Minimap ---- */
+
+#define PYR_BASE         4
+#define MINIMAP_W       40
+#define MINIMAP_H       12
+
+/* ---- Layout daemon ---- */
+
+#define SERVE_CACHE     64
+
+/* ---- Elided-edge markers drawn around focus boundary labels ---- */
+
+#define ELIDED_IN   L'\u2191'
+#define ELIDED_OUT  L'\u2193'
+
 /* ---- Direction bitmask for connectors ---- */
 
 #define DIR_N  1
@@ -44,9 +67,8 @@ typedef struct {
     char name[MAX_NAME];
     int adj_in[MAX_ADJ],  in_count;
     int adj_out[MAX_ADJ], out_count;
-    int level;
-    bool is_dummy;
     bool active;
+    bool elided_in, elided_out;   /* neighbours hidden by --focus or a full cluster */
 } Node;
 
 typedef struct {
@@ -55,65 +77,240 @@ typedef struct {
 } Graph;
 
 typedef struct {
-    int items[MAX_NODES];
+    int *items;
     int count;
 } NodeList;
 
+/* Level list entries are node indices, or chain slots encoded below zero. */
+#define SLOT_ITEM(slot)  (-(slot) - 1)
+#define ITEM_SLOT(item)  (-(item) - 1)
+#define IS_SLOT(item)    ((item) < 0)
+
+/* An edge spanning several levels, routed through one slot per level. */
+typedef struct {
+    int src, dst;           /* endpoints, as in the input graph */
+    int first, len;         /* slots first .. first + len - 1, src to dst */
+} Chain;
+
+typedef struct {
+    NodeList *levels;
+    int level_count;
+    int *node_level;
+    Chain *chains;
+    int chain_count;
+    int *slot_chain;        /* owning chain of each slot */
+    int slot_count;
+} Layout;
+
+/* Bump allocator for per-layout memory; everything is released at once. */
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+    size_t block_size;
+    DdAllocator mem;
+} Arena;
+
+/* Axis-aligned piece of an edge route, both ends inclusive. */
+typedef struct {
+    int x0, y0, x1, y1;
+    int edge;               /* index into the ep_* arrays */
+} Seg;
+
+/* A rasterised TILE_W x TILE_H block of the canvas, kept in an LRU. */
+typedef struct {
+    int key;                /* ty * tiles_x + tx, -1 when unused */
+    unsigned gen;           /* highlight generation it was drawn with */
+    unsigned long used;     /* LRU stamp */
+    wchar_t cells[TILE_W * TILE_H];
+    bool highlight[TILE_W * TILE_H];
+} Tile;
+
+/*
+ * Node placement and edge routes are computed for the whole drawing, but
+ * glyphs are only rasterised tile by tile when something looks at them.
+ */
 typedef struct {
-    wchar_t *cells;
-    uint8_t *dirs;
+    const Graph *g;
     int width, height;
+    int row_cap;            /* nodes per row; wider levels are folded */
 
     int node_col[MAX_NODES];
     int node_row[MAX_NODES];
+    int *slot_col, *slot_row;
     int bnd_xs[MAX_NODES], bnd_xe[MAX_NODES], bnd_y[MAX_NODES];
     bool has_bnd[MAX_NODES];
+    bool node_hl[MAX_NODES];
+    int node_lit[MAX_NODES], node_lit_count;  /* the nodes with node_hl */
 
-    int *pr, *pc;           /* path row/col pools */
-    int ptotal, pcap;
-    int ep_src[MAX_EDGES], ep_dst[MAX_EDGES];
-    int ep_off[MAX_EDGES],  ep_len[MAX_EDGES];
+    Seg *segs;
+    int seg_count;
+    int *ep_src, *ep_dst;
+    int *ep_off, *ep_len;   /* slice of segs for each edge */
+    bool *ep_hl;
+    int *ep_lit, ep_lit_count;        /* the edges with ep_hl */
     int ep_count;
+
+    int tiles_x, tiles_y;
+    int *tile_seg_off, *tile_seg;     /* segments touching each tile */
+    int *tile_node_off, *tile_node;   /* labels touching each tile */
+
+    Tile *cache;
+    int *tile_slot;         /* cache slot of each tile, -1 if not drawn */
+    unsigned hl_gen;
+    unsigned long tick;
 } Canvas;
 
+/* One resolution of the minimap: counts of covered canvas cells per
+ * scale x scale block, and how many of those are highlighted. */
+typedef struct {
+    int w, h;
+    int scale;
+    int *occ;
+    int *lit;
+} PyrLevel;
+
+typedef struct {
+    PyrLevel *levels;
+    int count;
+} Pyramid;
+
+/* Node groups that can be drawn as a single node. View graphs refer back
+ * to a cluster with a negative origin, like chain slots in level lists. */
+#define CLUSTER_ITEM(c)  (-(c) - 1)
+#define ITEM_CLUSTER(o)  (-(o) - 1)
+#define IS_CLUSTER(o)    ((o) < 0)
+
+typedef struct {
+    int group[MAX_NODES];           /* cluster of each node, -1 if none */
+    char key[MAX_NODES][MAX_NAME];
+    int size[MAX_NODES];
+    bool expanded[MAX_NODES];
+    int count;
+} Clusters;
+
+/* Interactive state carried across relayouts. */
+typedef struct {
+    int scroll_x, scroll_y;
+    int selected;
+    bool show_minimap;
+} ViewState;
+
+typedef enum { VIEW_QUIT, VIEW_TOGGLE } ViewAction;
+
 typedef struct {
     char src[MAX_NAME], dst[MAX_NAME];
 } RawEdge;
 
+typedef enum {
+    IN_AUTO, IN_EDGES, IN_DOT, IN_NINJA, IN_MAKE, IN_JSON,
+} InputFormat;
+
+typedef struct {
+    bool reduce;
+    int max_width;
+    InputFormat format;
+    int jobs;               /* worker threads, 0 for one per core */
+    const char *out_dir;    /* NULL writes everything to stdout */
+} BatchOptions;
+
+typedef struct {
+    bool reduce;
+    int max_width;
+    int jobs;               /* worker threads, 0 for one per core */
+    int cache;              /* graphs kept, least recently used go first */
+} ServeOptions;
+
+typedef struct Decoder Decoder;
+
 /* ---- Connector lookup table ---- */
 
 extern const wchar_t CONNECTOR[16];
 
+/* ---- Arena ---- */
+
+void  arena_init(Arena *a, size_t size_hint, const DdAllocator *mem);
+void *arena_alloc(Arena *a, size_t size);
+void  arena_free(Arena *a);
+
 /* ---- Graph operations ---- */
 
 void graph_init(Graph *g);
 int  graph_find(const Graph *g, const char *name);
 int  graph_add(Graph *g, const char *name);
 int  graph_find_or_add(Graph *g, const char *name);
-void graph_add_edge(Graph *g, int src, int dst);
+bool graph_add_edge(Graph *g, int src, int dst);
+void graph_from_edges(Graph *g, const RawEdge *edges, int count);
 void graph_remove_edge(Graph *g, int src, int dst);
 void graph_remove_node(Graph *g, int idx);
 void graph_twist(Graph *g, int (*edges)[2], int count);
+bool graph_transitive_reduce(Graph *g);
+void graph_extract_focus(const Graph *g, int focus, int up, int down,
+                         Graph *out);
 
 /* ---- Sugiyama layout ---- */
 
-void sugiyama(const Graph *orig, Graph *out, NodeList *levels, int *level_count);
+size_t sugiyama_arena_size(const Graph *g);
+bool   sugiyama(Arena *a, const Graph *g, const double *hint,
+                const bool *redo, Layout *out);
+void   layout_positions(const Graph *g, const Layout *lay, double *pos);
+
+/* ---- Clusters ---- */
+
+void cluster_init(Clusters *cl, const Graph *g);
+void cluster_by_delim(Clusters *cl, const Graph *g, char delim);
+void cluster_by_prefix(Clusters *cl, const Graph *g, const char *prefix);
+int  cluster_read(Clusters *cl, const Graph *g, FILE *fp);
+void cluster_collapse(const Clusters *cl, const Graph *g, Graph *out,
+                      int *origin);
+int  cluster_of(const Clusters *cl, const int *origin, int node);
+bool cluster_toggle(Clusters *cl, const int *origin, int node);
+void cluster_hints(const Clusters *cl, int base_count,
+                   const int *old_origin, const double *old_pos,
+                   int old_count, const int *origin, int count,
+                   double *hint);
 
 /* ---- Canvas ---- */
 
-int  canvas_compute_width(const Graph *g, const NodeList *levels,
-                          int level_count);
-void build_canvas(Canvas *cv, const Graph *g,
-                  const NodeList *levels, int level_count, int canvas_width);
+int  canvas_compute_width(const Graph *g, const Layout *lay, int max_width);
+bool canvas_place(Canvas *cv, Arena *a, const Graph *g, const Layout *lay,
+                  int canvas_width);
+void build_canvas(Canvas *cv, Arena *a, const Graph *g, const Layout *lay,
+                  int canvas_width);
+void canvas_select(Canvas *cv, int selected);
+wchar_t canvas_cell(Canvas *cv, int x, int y, bool *highlight);
+void canvas_print(const Canvas *cv, FILE *fp);
 void canvas_free(Canvas *cv);
 
+/* ---- Minimap pyramid ---- */
+
+bool pyramid_build(Pyramid *p, const Canvas *cv);
+void pyramid_light(Pyramid *p, const Canvas *cv, int sign);
+int  pyramid_pick(const Pyramid *p, int max_w, int max_h);
+void pyramid_free(Pyramid *p);
+
 /* ---- Rendering ---- */
 
-void event_loop(const Graph *g, const Canvas *cv);
+ViewAction event_loop(const Graph *g, Canvas *cv, ViewState *vs);
+
+/* ---- Batch mode ---- */
+
+int batch_run(const char *input, const BatchOptions *opt);
+
+/* ---- Layout daemon ---- */
+
+int serve_run(const char *path, const ServeOptions *opt);
+
+/* ---- Compressed input ---- */
+
+bool        decoder_detect(const char *head, size_t len);
+Decoder    *decoder_start(FILE *src, const char *head, size_t len, FILE **out);
+const char *decoder_finish(Decoder *d);
 
 /* ---- Input parsing ---- */
 
-int read_edges(FILE *fp, RawEdge *edges, int max);
+bool input_format(const char *name, InputFormat *fmt);
+int  read_graph(FILE *fp, InputFormat fmt, Graph *g);
 int default_edges(RawEdge *e);
 
 #endif /* DRAWDAG_H */
@@ -1,5 +1,6 @@
 #include "drawdag.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 /* ---- helpers ---- */
@@ -40,12 +41,28 @@ int graph_find_or_add(Graph *g, const char *name) {
     return idx >= 0 ? idx : graph_add(g, name);
 }
 
-void graph_add_edge(Graph *g, int src, int dst) {
+/* Both halves of the edge or neither: false, with nothing changed, when
+ * either adjacency list is full. An edge already there counts as added. */
+bool graph_add_edge(Graph *g, int src, int dst) {
     Node *s = &g->nodes[src], *d = &g->nodes[dst];
-    if (!has_adj(s->adj_out, s->out_count, dst) && s->out_count < MAX_ADJ)
-        s->adj_out[s->out_count++] = dst;
-    if (!has_adj(d->adj_in, d->in_count, src) && d->in_count < MAX_ADJ)
-        d->adj_in[d->in_count++] = src;
+    bool has_out = has_adj(s->adj_out, s->out_count, dst);
+    bool has_in = has_adj(d->adj_in, d->in_count, src);
+    if ((!has_out && s->out_count >= MAX_ADJ)
+        || (!has_in && d->in_count >= MAX_ADJ))
+        return false;
+    if (!has_out) s->adj_out[s->out_count++] = dst;
+    if (!has_in) d->adj_in[d->in_count++] = src;
+    return true;
+}
+
+/* Fresh graph from an edge list; edges past MAX_NODES nodes are dropped. */
+void graph_from_edges(Graph *g, const RawEdge *edges, int count) {
+    graph_init(g);
+    for (int i = 0; i < count; i++) {
+        int src = graph_find_or_add(g, edges[i].src);
+        int dst = graph_find_or_add(g, edges[i].dst);
+        if (src >= 0 && dst >= 0) graph_add_edge(g, src, dst);
+    }
 }
 
 void graph_remove_edge(Graph *g, int src, int dst) {
@@ -70,3 +87,115 @@ void graph_twist(Graph *g, int (*edges)[2], int count) {
     for (int i = 0; i < count; i++) graph_remove_edge(g, edges[i][0], edges[i][1]);
     for (int i = 0; i < count; i++) graph_add_edge(g, edges[i][1], edges[i][0]);
 }
+
+/* Drop every edge u->v where v is also reachable through another child of
+ * u. Reachability bitsets are filled in reverse topological order, and each
+ * node's children are visited closest-first so that a child already covered
+ * by an earlier sibling is known to be redundant. Returns false and leaves
+ * the graph untouched if it has a cycle. */
+bool graph_transitive_reduce(Graph *g) {
+    int n = g->count;
+    int words = (n + 63) / 64;
+    int *order = malloc(n * sizeof *order);
+    int *topo_pos = malloc(n * sizeof *topo_pos);
+    int *in_left = malloc(n * sizeof *in_left);
+    uint64_t *reach = calloc((size_t)n * words, sizeof *reach);
+    bool ok = false;
+    if (!order || !topo_pos || !in_left || !reach) goto done;
+
+    /* Kahn's algorithm */
+    int active = 0, head = 0, tail = 0;
+    for (int i = 0; i < n; i++) {
+        if (!g->nodes[i].active) continue;
+        active++;
+        in_left[i] = g->nodes[i].in_count;
+        if (in_left[i] == 0) order[tail++] = i;
+    }
+    while (head < tail) {
+        int node = order[head++];
+        topo_pos[node] = head - 1;
+        for (int i = 0; i < g->nodes[node].out_count; i++) {
+            int child = g->nodes[node].adj_out[i];
+            if (--in_left[child] == 0) order[tail++] = child;
+        }
+    }
+    if (tail != active) goto done;
+
+    for (int k = tail - 1; k >= 0; k--) {
+        int node = order[k];
+        uint64_t *row = reach + (size_t)node * words;
+        int kids[MAX_ADJ], kid_count = g->nodes[node].out_count;
+        memcpy(kids, g->nodes[node].adj_out, kid_count * sizeof *kids);
+        for (int i = 1; i < kid_count; i++)
+            for (int j = i; j > 0 && topo_pos[kids[j - 1]] > topo_pos[kids[j]]; j--) {
+                int swap = kids[j]; kids[j] = kids[j - 1]; kids[j - 1] = swap;
+            }
+        for (int i = 0; i < kid_count; i++) {
+            int child = kids[i];
+            if (row[child / 64] >> (child % 64) & 1) {
+                graph_remove_edge(g, node, child);
+                continue;
+            }
+            const uint64_t *sub = reach + (size_t)child * words;
+            for (int w = 0; w < words; w++) row[w] |= sub[w];
+            row[child / 64] |= (uint64_t)1 << (child % 64);
+        }
+    }
+    ok = true;
+
+done:
+    free(order); free(topo_pos); free(in_left); free(reach);
+    return ok;
+}
+
+/* Copy into out the nodes within `up` steps above and `down` steps below
+ * focus (negative means unbounded), with every edge between them. Kept
+ * nodes that lose a neighbour are flagged elided_in / elided_out. */
+void graph_extract_focus(const Graph *g, int focus, int up, int down,
+                         Graph *out) {
+    graph_init(out);
+    int *depth = malloc(g->count * sizeof *depth);
+    int *queue = malloc(g->count * sizeof *queue);
+    int *remap = malloc(g->count * sizeof *remap);
+    if (!depth || !queue || !remap) goto done;
+    for (int i = 0; i < g->count; i++) remap[i] = -1;
+
+    /* one BFS over adj_in for ancestors, one over adj_out for descendants */
+    for (int pass = 0; pass < 2; pass++) {
+        int limit = pass ? down : up;
+        for (int i = 0; i < g->count; i++) depth[i] = -1;
+        int head = 0, tail = 0;
+        depth[focus] = 0;
+        queue[tail++] = focus;
+        while (head < tail) {
+            int node = queue[head++];
+            remap[node] = 0;
+            if (limit >= 0 && depth[node] >= limit) continue;
+            const Node *n = &g->nodes[node];
+            const int *adj = pass ? n->adj_out : n->adj_in;
+            int count = pass ? n->out_count : n->in_count;
+            for (int i = 0; i < count; i++)
+                if (depth[adj[i]] < 0) {
+                    depth[adj[i]] = depth[node] + 1;
+                    queue[tail++] = adj[i];
+                }
+        }
+    }
+
+    for (int i = 0; i < g->count; i++)
+        if (remap[i] == 0) remap[i] = graph_add(out, g->nodes[i].name);
+    for (int i = 0; i < g->count; i++) {
+        if (remap[i] < 0) continue;
+        Node *kept = &out->nodes[remap[i]];
+        for (int j = 0; j < g->nodes[i].out_count; j++) {
+            int child = g->nodes[i].adj_out[j];
+            if (remap[child] >= 0) graph_add_edge(out, remap[i], remap[child]);
+            else                   kept->elided_out = true;
+        }
+        for (int j = 0; j < g->nodes[i].in_count; j++)
+            if (remap[g->nodes[i].adj_in[j]] < 0) kept->elided_in = true;
+    }
+
+done:
+    free(depth); free(queue); free(remap);
+}
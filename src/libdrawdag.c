@@ -0,0 +1,130 @@
+#include "drawdag.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct DdGraph {
+    DdAllocator mem;
+    Graph g;
+};
+
+/* Everything a layout owns lives in its arena, the handle included. */
+struct DdLayout {
+    Arena arena;
+    int width, height;
+    DdNode *nodes;
+    int node_count;
+    DdSegment *segs;
+    int seg_count;
+};
+
+/* ---- helpers ---- */
+
+static void *mem_alloc(const DdAllocator *mem, size_t size) {
+    return mem->alloc ? mem->alloc(mem->ctx, size) : malloc(size);
+}
+
+static void mem_free(const DdAllocator *mem, void *ptr) {
+    if (mem->free) mem->free(mem->ctx, ptr);
+    else           free(ptr);
+}
+
+/* ---- graphs ---- */
+
+DdGraph *dd_graph_new(const DdAllocator *mem) {
+    DdAllocator m = mem ? *mem : (DdAllocator){0};
+    DdGraph *g = mem_alloc(&m, sizeof *g);
+    if (!g) return NULL;
+    g->mem = m;
+    graph_init(&g->g);
+    return g;
+}
+
+void dd_graph_free(DdGraph *g) {
+    if (g) mem_free(&g->mem, g);
+}
+
+/* Index of the node with this name, added if new; -1 when full. */
+int dd_graph_node(DdGraph *g, const char *name) {
+    return graph_find_or_add(&g->g, name);
+}
+
+/* 0 on success, -1 for an unknown node or a full adjacency list. */
+int dd_graph_edge(DdGraph *g, int src, int dst) {
+    if (src < 0 || src >= g->g.count || dst < 0 || dst >= g->g.count)
+        return -1;
+    return graph_add_edge(&g->g, src, dst) ? 0 : -1;
+}
+
+int dd_graph_node_count(const DdGraph *g) {
+    return g->g.count;
+}
+
+const char *dd_graph_node_name(const DdGraph *g, int node) {
+    if (node < 0 || node >= g->g.count) return NULL;
+    return g->g.nodes[node].name;
+}
+
+/* ---- layouts ---- */
+
+/* NULL when any allocation fails; never a partial layout. */
+DdLayout *dd_layout_new(const DdGraph *graph, const DdOptions *opt,
+                        const DdAllocator *mem) {
+    const Graph *g = &graph->g;
+    Arena arena;
+    arena_init(&arena, sugiyama_arena_size(g), mem);
+
+    DdLayout *out = arena_alloc(&arena, sizeof *out);
+    Layout *lay = arena_alloc(&arena, sizeof *lay);
+    Canvas *cv = arena_alloc(&arena, sizeof *cv);
+    if (!out || !lay || !cv) goto fail;
+
+    if (!sugiyama(&arena, g, NULL, NULL, lay)) goto fail;
+    int width = canvas_compute_width(g, lay, opt ? opt->max_width : 0);
+    if (!canvas_place(cv, &arena, g, lay, width)) goto fail;
+
+    out->width = cv->width;
+    out->height = cv->height;
+    out->node_count = g->count;
+    out->seg_count = cv->seg_count;
+    out->nodes = arena_alloc(&arena, (g->count + 1) * sizeof *out->nodes);
+    out->segs = arena_alloc(&arena, (cv->seg_count + 1) * sizeof *out->segs);
+    if (!out->nodes || !out->segs) goto fail;
+
+    for (int i = 0; i < g->count; i++)
+        out->nodes[i] = (DdNode){cv->node_col[i], cv->node_row[i],
+                                 cv->bnd_xs[i], cv->bnd_xe[i]};
+    for (int i = 0; i < cv->seg_count; i++) {
+        const Seg *s = &cv->segs[i];
+        out->segs[i] = (DdSegment){s->x0, s->y0, s->x1, s->y1,
+                                   cv->ep_src[s->edge], cv->ep_dst[s->edge]};
+    }
+    out->arena = arena;
+    return out;
+
+fail:
+    arena_free(&arena);
+    return NULL;
+}
+
+void dd_layout_free(DdLayout *lay) {
+    if (!lay) return;
+    /* the handle lives in the arena it frees */
+    Arena arena = lay->arena;
+    arena_free(&arena);
+}
+
+void dd_layout_size(const DdLayout *lay, int *width, int *height) {
+    if (width)  *width = lay->width;
+    if (height) *height = lay->height;
+}
+
+const DdNode *dd_layout_nodes(const DdLayout *lay, int *count) {
+    *count = lay->node_count;
+    return lay->nodes;
+}
+
+const DdSegment *dd_layout_segments(const DdLayout *lay, int *count) {
+    *count = lay->seg_count;
+    return lay->segs;
+}
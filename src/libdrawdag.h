@@ -0,0 +1,68 @@
+/*
+ * libdrawdag.h - DAG layout library
+ *
+ * Lays out a graph and returns node coordinates and edge segments on the
+ * same character grid drawdag draws on. There is no global state and
+ * every allocation goes through the caller's allocator, so independent
+ * graphs can be laid out concurrently from any number of threads.
+ */
+
+#ifndef LIBDRAWDAG_H
+#define LIBDRAWDAG_H
+
+#include <stddef.h>
+
+/* The shared library is built with hidden visibility; only these names
+ * are exported. */
+#if defined(__GNUC__)
+#define DD_API __attribute__((visibility("default")))
+#else
+#define DD_API
+#endif
+
+/* Passing NULL, or leaving both functions NULL, means malloc/free. */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void  (*free)(void *ctx, void *ptr);
+    void *ctx;
+} DdAllocator;
+
+typedef struct DdGraph DdGraph;
+typedef struct DdLayout DdLayout;
+
+typedef struct {
+    int max_width;          /* fold wider levels into sub-rows, 0 for none */
+} DdOptions;
+
+/* Edges attach at (x, y); the label covers columns label_x0..label_x1. */
+typedef struct {
+    int x, y;
+    int label_x0, label_x1;
+} DdNode;
+
+/* Axis-aligned piece of the route of edge src -> dst, ends inclusive. */
+typedef struct {
+    int x0, y0, x1, y1;
+    int src, dst;
+} DdSegment;
+
+/* ---- Graphs ---- */
+
+DD_API DdGraph    *dd_graph_new(const DdAllocator *mem);
+DD_API void        dd_graph_free(DdGraph *g);
+DD_API int         dd_graph_node(DdGraph *g, const char *name);
+DD_API int         dd_graph_edge(DdGraph *g, int src, int dst);
+DD_API int         dd_graph_node_count(const DdGraph *g);
+DD_API const char *dd_graph_node_name(const DdGraph *g, int node);
+
+/* ---- Layouts ---- */
+
+DD_API DdLayout        *dd_layout_new(const DdGraph *g, const DdOptions *opt,
+                                      const DdAllocator *mem);
+DD_API void             dd_layout_free(DdLayout *lay);
+DD_API void             dd_layout_size(const DdLayout *lay,
+                                       int *width, int *height);
+DD_API const DdNode    *dd_layout_nodes(const DdLayout *lay, int *count);
+DD_API const DdSegment *dd_layout_segments(const DdLayout *lay, int *count);
+
+#endif /* LIBDRAWDAG_H */
@@ -5,35 +5,157 @@
 #include <stdlib.h>
 #include <string.h>
 
-static void print_canvas(const Canvas *cv) {
-    char buf[MAX_NAME * MAX_NODES];
-    for (int row = 0; row < cv->height; row++) {
-        int len = 0;
-        for (int col = 0; col < cv->width; col++)
-            len += wctomb(buf + len, cv->cells[row * cv->width + col]);
-        /* trim trailing spaces */
-        while (len > 0 && buf[len - 1] == ' ') len--;
-        buf[len] = '\0';
-        puts(buf);
+/* One laid-out drawing. Two are kept across a relayout so that the new
+ * ordering can be seeded from the old one. */
+typedef struct {
+    Graph collapsed;
+    const Graph *g;
+    int origin[MAX_NODES];
+    double pos[MAX_NODES];
+    Arena arena;
+    Layout layout;
+    Canvas cv;
+} View;
+
+static bool view_build(View *v, const Graph *g, const Clusters *cl,
+                       const View *prev, int toggled, int max_width) {
+    double hint[MAX_NODES];
+    bool redo[MAX_NODES];
+    if (cl) {
+        cluster_collapse(cl, g, &v->collapsed, v->origin);
+        v->g = &v->collapsed;
+    } else {
+        v->g = g;
+        for (int i = 0; i < g->count; i++) v->origin[i] = i;
+    }
+    if (prev && cl) {
+        cluster_hints(cl, g->count, prev->origin, prev->pos, prev->g->count,
+                      v->origin, v->g->count, hint);
+        /* only the toggled cluster's levels are reordered */
+        for (int k = 0; k < v->g->count; k++)
+            redo[k] = cluster_of(cl, v->origin, k) == toggled;
+    }
+
+    arena_init(&v->arena, sugiyama_arena_size(v->g), NULL);
+    if (!sugiyama(&v->arena, v->g, prev && cl ? hint : NULL,
+                  prev && cl ? redo : NULL, &v->layout)) {
+        arena_free(&v->arena);
+        return false;
     }
+    layout_positions(v->g, &v->layout, v->pos);
+
+    memset(&v->cv, 0, sizeof v->cv);
+    build_canvas(&v->cv, &v->arena, v->g, &v->layout,
+                 canvas_compute_width(v->g, &v->layout, max_width));
+    return true;
+}
+
+static void view_free(View *v) {
+    canvas_free(&v->cv);
+    arena_free(&v->arena);
+}
+
+static int view_find(const View *v, int origin) {
+    for (int k = 0; k < v->g->count; k++)
+        if (v->origin[k] == origin) return k;
+    return -1;
+}
+
+/* After toggling the cluster of `node`, keep that spot of the drawing
+ * where it was on screen and select the collapsed cluster, if any. */
+static void view_follow(ViewState *vs, const Clusters *cl, int base_count,
+                        const View *old, const View *cur, int node) {
+    int origin = old->origin[node];
+    int anchor = -1;
+    if (IS_CLUSTER(origin)) {
+        for (int b = 0; b < base_count; b++)
+            if (cl->group[b] == ITEM_CLUSTER(origin)
+                && (anchor = view_find(cur, b)) >= 0)
+                break;
+        vs->selected = -1;
+    } else {
+        anchor = view_find(cur, CLUSTER_ITEM(cl->group[origin]));
+        vs->selected = anchor;
+    }
+    if (anchor < 0) return;
+    vs->scroll_x += cur->cv.node_col[anchor] - old->cv.node_col[node];
+    vs->scroll_y += cur->cv.node_row[anchor] - old->cv.node_row[node];
 }
 
 int main(int argc, char *argv[]) {
     setlocale(LC_ALL, "");
 
-    bool batch = false;
-    RawEdge edges[MAX_EDGES];
+    bool batch = false, reduce = false;
+    InputFormat format = IN_AUTO;
     int edge_count = 0;
-    const char *file_arg = NULL;
+    const char *file_arg = NULL, *focus = NULL, *cluster_file = NULL;
+    const char *batch_input = NULL, *serve_path = NULL;
+    BatchOptions batch_opt = {0};
+    ServeOptions serve_opt = {.cache = SERVE_CACHE};
+    const char *prefixes[argc];
+    int up = -1, down = -1, prefix_count = 0, max_width = 0;
+    char cluster_delim = '\0';
 
     /* parse arguments */
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--print") == 0)
             batch = true;
+        else if (strcmp(argv[i], "--reduce") == 0)
+            reduce = true;
+        else if (strcmp(argv[i], "--focus") == 0 && i + 1 < argc)
+            focus = argv[++i];
+        else if (strcmp(argv[i], "--up") == 0 && i + 1 < argc)
+            up = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--down") == 0 && i + 1 < argc)
+            down = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            up = down = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!input_format(argv[++i], &format)) {
+                fprintf(stderr, "Unknown format: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--max-width") == 0 && i + 1 < argc)
+            max_width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            batch_input = argv[++i];
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve_path = argv[++i];
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            serve_opt.cache = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+            batch_opt.jobs = serve_opt.jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            batch_opt.out_dir = argv[++i];
+        else if (strcmp(argv[i], "--cluster-delim") == 0 && i + 1 < argc)
+            cluster_delim = argv[++i][0];
+        else if (strcmp(argv[i], "--cluster-prefix") == 0 && i + 1 < argc)
+            prefixes[prefix_count++] = argv[++i];
+        else if (strcmp(argv[i], "--clusters") == 0 && i + 1 < argc)
+            cluster_file = argv[++i];
         else
             file_arg = argv[i];
     }
 
+    /* layouts on request, over a socket */
+    if (serve_path) {
+        if (serve_opt.cache < 1) serve_opt.cache = 1;
+        serve_opt.reduce = reduce;
+        serve_opt.max_width = max_width;
+        return serve_run(serve_path, &serve_opt);
+    }
+
+    /* many graphs, printed in parallel */
+    if (batch_input) {
+        batch_opt.reduce = reduce;
+        batch_opt.max_width = max_width;
+        batch_opt.format = format;
+        return batch_run(batch_input, &batch_opt);
+    }
+
+    /* build graph */
+    Graph orig;
     if (file_arg) {
         FILE *fp;
         if (strcmp(file_arg, "-") == 0) {
@@ -42,48 +164,81 @@ int main(int argc, char *argv[]) {
             fp = fopen(file_arg, "r");
             if (!fp) { perror(file_arg); return 1; }
         }
-        edge_count = read_edges(fp, edges, MAX_EDGES);
+        edge_count = read_graph(fp, format, &orig);
         if (fp != stdin) fclose(fp);
         if (fp == stdin && !batch && !freopen("/dev/tty", "r", stdin)) {
             fprintf(stderr, "Cannot open /dev/tty\n");
             return 1;
         }
     } else {
+        RawEdge edges[32];
         edge_count = default_edges(edges);
+        graph_from_edges(&orig, edges, edge_count);
     }
 
     if (edge_count == 0) { fprintf(stderr, "No edges\n"); return 1; }
+    if (reduce && !graph_transitive_reduce(&orig))
+        fprintf(stderr, "Graph has cycles, --reduce ignored\n");
 
-    /* build graph */
-    Graph orig;
-    graph_init(&orig);
-    for (int i = 0; i < edge_count; i++) {
-        int src = graph_find_or_add(&orig, edges[i].src);
-        int dst = graph_find_or_add(&orig, edges[i].dst);
-        graph_add_edge(&orig, src, dst);
+    /* restrict to the neighbourhood of one node */
+    Graph *g = &orig;
+    Graph sub;
+    if (focus) {
+        int idx = graph_find(&orig, focus);
+        if (idx < 0) { fprintf(stderr, "Unknown node: %s\n", focus); return 1; }
+        graph_extract_focus(&orig, idx, up, down, &sub);
+        g = &sub;
     }
 
-    /* layout */
-    Graph layout;
-    NodeList levels[MAX_LEVELS];
-    int level_count;
-    sugiyama(&orig, &layout, levels, &level_count);
-
-    int canvas_width = canvas_compute_width(&layout, levels, level_count);
+    /* group nodes; explicit groups win over prefixes, then delimiters */
+    Clusters clusters, *cl = NULL;
+    if (cluster_file || prefix_count || cluster_delim) {
+        cl = &clusters;
+        cluster_init(cl, g);
+        if (cluster_file) {
+            FILE *fp = fopen(cluster_file, "r");
+            if (!fp) { perror(cluster_file); return 1; }
+            cluster_read(cl, g, fp);
+            fclose(fp);
+        }
+        for (int i = 0; i < prefix_count; i++)
+            cluster_by_prefix(cl, g, prefixes[i]);
+        if (cluster_delim) cluster_by_delim(cl, g, cluster_delim);
+    }
 
-    Canvas cv = {0};
-    build_canvas(&cv, &layout, levels, level_count, canvas_width);
+    /* layout */
+    View *views = calloc(2, sizeof *views);
+    if (!views) { fprintf(stderr, "Out of memory\n"); return 1; }
+    View *cur = &views[0], *next = &views[1];
+    if (!view_build(cur, g, cl, NULL, -1, max_width)) {
+        fprintf(stderr, "Out of memory\n");
+        free(views);
+        return 1;
+    }
 
     if (batch) {
-        print_canvas(&cv);
+        canvas_print(&cur->cv, stdout);
     } else {
         initscr();
         noecho();
         keypad(stdscr, TRUE);
-        event_loop(&layout, &cv);
+        ViewState vs = {.selected = -1};
+        while (event_loop(cur->g, &cur->cv, &vs) == VIEW_TOGGLE) {
+            int node = vs.selected;
+            if (!cl || !cluster_toggle(cl, cur->origin, node)) continue;
+            if (!view_build(next, g, cl, cur,
+                            cluster_of(cl, cur->origin, node), max_width)) {
+                cluster_toggle(cl, cur->origin, node);      /* undo */
+                continue;
+            }
+            view_follow(&vs, cl, g->count, cur, next, node);
+            view_free(cur);
+            View *swap = cur; cur = next; next = swap;
+        }
         endwin();
     }
 
-    canvas_free(&cv);
+    view_free(cur);
+    free(views);
     return 0;
 }
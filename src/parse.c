@@ -1,19 +1,798 @@
 #include "drawdag.h"
 
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
-int read_edges(FILE *fp, RawEdge *edges, int max) {
-    int n = 0;
-    char line[256];
-    while (fgets(line, sizeof line, fp) && n < max) {
-        char *p = line;
-        while (*p == ' ' || *p == '\t') p++;
-        if (*p == '#' || *p == '\n' || *p == '\0') continue;
-        if (sscanf(p, "%63s %63s", edges[n].src, edges[n].dst) == 2) n++;
+#define HEAD_SIZE   4096    /* bytes looked at to guess the format */
+#define DOT_DEPTH     32
+#define JSON_DEPTH    64
+
+/* Buffered input: the sniffed head first, then the rest of the stream. */
+typedef struct {
+    FILE *fp;
+    char head[HEAD_SIZE + 1];
+    size_t head_len, head_pos;
+    int back;               /* pushed back character */
+    bool has_back;
+    char *line;
+    size_t line_cap;
+} Reader;
+
+/* Distinct names that found the graph full, counted for the warning. */
+typedef struct {
+    char **name;            /* open addressing, cap a power of two */
+    size_t cap, count;
+} NameSet;
+
+/* Edges go straight into the graph as they are parsed. */
+typedef struct {
+    Reader in;
+    Graph *g;
+    int edges;
+    NameSet dropped;
+    int dropped_edges;
+    /* DOT node labels, applied once every id has been seen */
+    char (*label)[2][MAX_NAME];
+    int label_count, label_cap;
+} Parser;
+
+/* ---- reading ---- */
+
+static int rd_getc(Reader *r) {
+    if (r->has_back) {
+        r->has_back = false;
+        return r->back;
+    }
+    if (r->head_pos < r->head_len) return (unsigned char)r->head[r->head_pos++];
+    return getc_unlocked(r->fp);
+}
+
+static void rd_ungetc(Reader *r, int c) {
+    r->back = c;
+    r->has_back = true;
+}
+
+/* Next line without its line ending, or NULL at the end of input. */
+static char *rd_line(Reader *r) {
+    size_t len = 0;
+    int c;
+    for (;;) {
+        c = rd_getc(r);
+        if (len + 1 >= r->line_cap) {
+            size_t cap = r->line_cap ? 2 * r->line_cap : 256;
+            char *line = realloc(r->line, cap);
+            if (!line) return NULL;
+            r->line = line;
+            r->line_cap = cap;
+        }
+        if (c == EOF || c == '\n') break;
+        r->line[len++] = (char)c;
+    }
+    if (c == EOF && len == 0) return NULL;
+    if (len > 0 && r->line[len - 1] == '\r') len--;
+    r->line[len] = '\0';
+    return r->line;
+}
+
+/* Next whitespace-separated word of *s, or NULL. */
+static char *next_word(char **s) {
+    char *p = *s + strspn(*s, " \t");
+    if (!*p) return NULL;
+    char *end = p + strcspn(p, " \t");
+    if (*end) *end++ = '\0';
+    *s = end;
+    return p;
+}
+
+/* ---- graph building ---- */
+
+static size_t name_hash(const char *s) {
+    size_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+/* Where name is, or the empty slot it would go in. */
+static size_t name_slot(const NameSet *set, const char *name) {
+    size_t i = name_hash(name) & (set->cap - 1);
+    while (set->name[i] && strcmp(set->name[i], name) != 0)
+        i = (i + 1) & (set->cap - 1);
+    return i;
+}
+
+/* Count name once; past an allocation failure the count may run high. */
+static void note_dropped(NameSet *set, const char *name) {
+    if (2 * (set->count + 1) > set->cap) {
+        size_t cap = set->cap ? 2 * set->cap : 64;
+        NameSet bigger = {calloc(cap, sizeof *bigger.name), cap, set->count};
+        if (!bigger.name) {
+            set->count++;
+            return;
+        }
+        for (size_t j = 0; j < set->cap; j++)
+            if (set->name[j])
+                bigger.name[name_slot(&bigger, set->name[j])] = set->name[j];
+        free(set->name);
+        *set = bigger;
+    }
+    size_t i = name_slot(set, name);
+    if (set->name[i]) return;
+    set->name[i] = strdup(name);
+    set->count++;
+}
+
+static void names_free(NameSet *set) {
+    for (size_t i = 0; i < set->cap; i++) free(set->name[i]);
+    free(set->name);
+    memset(set, 0, sizeof *set);
+}
+
+static int intern(Parser *p, const char *name) {
+    char key[MAX_NAME];
+    snprintf(key, sizeof key, "%s", name);
+    int node = graph_find_or_add(p->g, key);
+    if (node < 0) note_dropped(&p->dropped, key);
+    return node;
+}
+
+/* Edges to nodes past MAX_NODES, or past MAX_ADJ neighbours, are dropped
+ * and counted. */
+static void add_edge(Parser *p, int src, int dst) {
+    if (src < 0 || dst < 0 || !graph_add_edge(p->g, src, dst)) {
+        p->dropped_edges++;
+        return;
+    }
+    p->edges++;
+}
+
+/* Source first, so nodes are numbered in the order they are read. */
+static void add_named(Parser *p, const char *src, const char *dst) {
+    int s = intern(p, src);
+    add_edge(p, s, intern(p, dst));
+}
+
+/* ---- plain edge lists ---- */
+
+#define MAKE_DB "# Make data base"
+
+static void parse_make(Parser *p, bool in_db);
+
+/*
+ * With detect set, a make data base header means the input is make -p
+ * output after all: its recipe echo, which can run far past the sniffed
+ * head, was read as edges, so start over with the rules that follow.
+ */
+static void parse_edges(Parser *p, bool detect) {
+    char *line;
+    while ((line = rd_line(&p->in))) {
+        if (detect && strncmp(line, MAKE_DB, strlen(MAKE_DB)) == 0) {
+            graph_init(p->g);
+            p->edges = p->dropped_edges = 0;
+            names_free(&p->dropped);
+            parse_make(p, true);
+            return;
+        }
+        char *s = line;
+        char *src = next_word(&s), *dst = next_word(&s);
+        if (!src || *src == '#' || !dst) continue;
+        add_named(p, src, dst);
+    }
+}
+
+/* ---- ninja -t deps ---- */
+
+/* "TARGET: #deps N, deps mtime T (STATE)", then one indented dependency
+ * per line. */
+static void parse_ninja_deps(Parser *p) {
+    int target = -1;
+    char *line;
+    while ((line = rd_line(&p->in))) {
+        if (*line == ' ' || *line == '\t') {
+            char *s = line, *dep = next_word(&s);
+            if (dep && target >= 0) add_edge(p, intern(p, dep), target);
+            continue;
+        }
+        char *mark = strstr(line, ": #deps");
+        target = -1;
+        if (mark) {
+            *mark = '\0';
+            target = intern(p, line);
+        }
+    }
+}
+
+/* ---- make -pn ---- */
+
+/* Special targets (.PHONY, .SUFFIXES) and suffix rules (.c.o) are not
+ * files; .build/foo.o and .cache are. */
+static bool make_special(const char *word) {
+    if (*word++ != '.') return false;
+    size_t upper = strspn(word, "ABCDEFGHIJKLMNOPQRSTUVWXYZ_");
+    if (upper > 0 && !word[upper]) return true;
+    size_t first = strcspn(word, "./");
+    if (first == 0 || word[first] != '.') return false;
+    size_t second = strcspn(word + first + 1, "./");
+    return second > 0 && !word[first + 1 + second];
+}
+
+/* Rule lines "TARGETS: PREREQS" of make's data base; comments, recipes,
+ * variables, special and pattern targets are skipped. Everything before
+ * the data base header, such as the recipes echoed by -n, is ignored
+ * unless in_db says the header was already read. */
+static void parse_make(Parser *p, bool in_db) {
+    bool not_target = false, in_define = false;
+    int targets[MAX_ADJ];
+    char *line;
+    while ((line = rd_line(&p->in))) {
+        if (!in_db) {
+            in_db = strncmp(line, MAKE_DB, strlen(MAKE_DB)) == 0;
+            continue;
+        }
+        if (in_define) {
+            if (strncmp(line, "endef", 5) == 0) in_define = false;
+            continue;
+        }
+        if (*line == '#') {
+            if (strstr(line, "# Not a target:")) not_target = true;
+            continue;
+        }
+        if (*line == '\t' || !*line) continue;
+        if (strncmp(line, "define ", 7) == 0) {
+            in_define = true;
+            continue;
+        }
+        char *colon = strchr(line, ':'), *eq = strchr(line, '=');
+        if (!colon || (eq && eq < colon) || colon[1] == '='
+            || (colon[1] == ':' && colon[2] == '='))
+            continue;
+        if (not_target) {
+            not_target = false;
+            continue;
+        }
+        char *prereqs = colon + 1 + (colon[1] == ':');
+        if (strchr(prereqs, '=')) continue;     /* target-specific variable */
+        *colon = '\0';
+
+        int count = 0;
+        char *s = line, *word;
+        while ((word = next_word(&s)) && count < MAX_ADJ)
+            if (!make_special(word) && !strchr(word, '%'))
+                targets[count++] = intern(p, word);
+        s = prereqs;
+        while (count > 0 && (word = next_word(&s))) {
+            if (strcmp(word, "|") == 0) continue;
+            int src = intern(p, word);
+            for (int t = 0; t < count; t++) add_edge(p, src, targets[t]);
+        }
+    }
+}
+
+/* ---- DOT ---- */
+
+typedef enum { TOK_EOF, TOK_ID, TOK_EDGE, TOK_PUNCT } TokKind;
+
+typedef struct {
+    TokKind kind;
+    char text[MAX_NAME];    /* TOK_ID, truncated */
+    bool quoted;            /* quoted ids are never keywords */
+    char punct;             /* TOK_PUNCT: [ ] { } ; , = : */
+} Token;
+
+typedef struct {
+    Parser *p;
+    Token peek;
+    bool peeked;
+    /* nodes named at each brace level, for "{a b} -> c" */
+    int frame[DOT_DEPTH][MAX_NODES];
+    int frame_len[DOT_DEPTH];
+    int depth;
+    int left[MAX_NODES], right[MAX_NODES];
+} Dot;
+
+static void tok_put(Token *t, size_t *len, int c) {
+    if (*len + 1 < sizeof t->text) t->text[(*len)++] = (char)c;
+}
+
+static bool id_char(int c) {
+    return isalnum(c) || c == '_' || c == '.' || c >= 0x80;
+}
+
+static void dot_lex(Reader *r, Token *t) {
+    int c;
+    size_t len = 0;
+    for (;;) {
+        c = rd_getc(r);
+        if (c == '#') {
+            while (c != EOF && c != '\n') c = rd_getc(r);
+        } else if (c == '/') {
+            int next = rd_getc(r);
+            if (next == '/') {
+                while (c != EOF && c != '\n') c = rd_getc(r);
+            } else if (next == '*') {
+                int prev = 0;
+                while ((c = rd_getc(r)) != EOF && !(prev == '*' && c == '/'))
+                    prev = c;
+            } else {
+                rd_ungetc(r, next);
+                break;
+            }
+        } else if (!isspace(c)) {
+            break;
+        }
+    }
+
+    t->kind = TOK_ID;
+    t->quoted = c == '"' || c == '<';
+    if (c == EOF) {
+        t->kind = TOK_EOF;
+    } else if (c == '-') {
+        int next = rd_getc(r);
+        if (next == '>' || next == '-') {
+            t->kind = TOK_EDGE;
+            return;
+        }
+        rd_ungetc(r, next);
+        tok_put(t, &len, c);
+        while (id_char(c = rd_getc(r))) tok_put(t, &len, c);
+        rd_ungetc(r, c);
+    } else if (c == '"') {
+        while ((c = rd_getc(r)) != EOF && c != '"') {
+            if (c == '\\') {
+                int next = rd_getc(r);
+                if (next == '\n') continue;
+                if (next != '"') tok_put(t, &len, c);
+                c = next;
+            }
+            tok_put(t, &len, c);
+        }
+    } else if (c == '<') {
+        for (int nest = 1; nest > 0 && (c = rd_getc(r)) != EOF; ) {
+            nest += (c == '<') - (c == '>');
+            if (nest > 0) tok_put(t, &len, c);
+        }
+    } else if (id_char(c)) {
+        do tok_put(t, &len, c); while (id_char(c = rd_getc(r)));
+        rd_ungetc(r, c);
+    } else {
+        t->kind = TOK_PUNCT;
+        t->punct = (char)c;
+    }
+    t->text[len] = '\0';
+}
+
+static Token *dot_peek(Dot *d) {
+    if (!d->peeked) {
+        dot_lex(&d->p->in, &d->peek);
+        d->peeked = true;
+    }
+    return &d->peek;
+}
+
+static Token dot_next(Dot *d) {
+    dot_peek(d);
+    d->peeked = false;
+    return d->peek;
+}
+
+static bool dot_is(Dot *d, char punct) {
+    Token *t = dot_peek(d);
+    return t->kind == TOK_PUNCT && t->punct == punct;
+}
+
+static bool keyword(const Token *t, const char *word) {
+    return t->kind == TOK_ID && !t->quoted && strcasecmp(t->text, word) == 0;
+}
+
+/* Skip an attribute list after its '['; returns the label, if any. */
+static bool dot_attrs(Dot *d, char *label) {
+    bool found = false;
+    for (;;) {
+        Token key = dot_next(d);
+        if (key.kind == TOK_EOF
+            || (key.kind == TOK_PUNCT && key.punct == ']'))
+            return found;
+        if (key.kind != TOK_ID || !dot_is(d, '=')) continue;
+        dot_next(d);
+        Token value = dot_next(d);
+        if (strcmp(key.text, "label") == 0 && value.kind == TOK_ID) {
+            memcpy(label, value.text, MAX_NAME);
+            found = true;
+        }
+    }
+}
+
+static void dot_label(Parser *p, const char *id, const char *label) {
+    if (strcmp(label, "\\N") == 0) return;
+    if (p->label_count == p->label_cap) {
+        int cap = p->label_cap ? 2 * p->label_cap : 64;
+        void *grown = realloc(p->label, cap * sizeof *p->label);
+        if (!grown) return;
+        p->label = grown;
+        p->label_cap = cap;
+    }
+    snprintf(p->label[p->label_count][0], MAX_NAME, "%s", id);
+    snprintf(p->label[p->label_count][1], MAX_NAME, "%s", label);
+    p->label_count++;
+}
+
+/* A node id, minus its ":port:compass" suffix, noted in the open group. */
+static int dot_node(Dot *d, const Token *t) {
+    while (dot_is(d, ':')) {
+        dot_next(d);
+        if (dot_peek(d)->kind == TOK_ID) dot_next(d);
+    }
+    int node = intern(d->p, t->text);
+    if (node >= 0 && d->depth > 0 && d->depth <= DOT_DEPTH) {
+        int f = d->depth - 1;
+        if (d->frame_len[f] < MAX_NODES) d->frame[f][d->frame_len[f]++] = node;
+    }
+    return node;
+}
+
+/* The ids of a "{...}" edge operand, after its '{'. */
+static int dot_group(Dot *d, int *out) {
+    int n = 0, nest = 1;
+    while (nest > 0) {
+        Token t = dot_next(d);
+        if (t.kind == TOK_EOF) break;
+        if (t.kind == TOK_PUNCT) {
+            nest += (t.punct == '{') - (t.punct == '}');
+            if (t.punct == '[') {
+                char label[MAX_NAME];
+                dot_attrs(d, label);
+            }
+        } else if (t.kind == TOK_ID && !keyword(&t, "subgraph")) {
+            if (dot_is(d, '=')) {
+                dot_next(d);
+                dot_next(d);
+                continue;
+            }
+            int node = dot_node(d, &t);
+            if (node >= 0 && n < MAX_NODES) out[n++] = node;
+        }
     }
     return n;
 }
 
+/* "left -> right -> ..." once the first operand is known. */
+static void dot_edges(Dot *d, int left_count) {
+    while (dot_peek(d)->kind == TOK_EDGE) {
+        dot_next(d);
+        Token t = dot_next(d);
+        if (keyword(&t, "subgraph")) {
+            if (dot_peek(d)->kind == TOK_ID) dot_next(d);
+            t = dot_next(d);
+        }
+        int right_count = 0;
+        if (t.kind == TOK_PUNCT && t.punct == '{') {
+            right_count = dot_group(d, d->right);
+        } else if (t.kind == TOK_ID) {
+            int node = dot_node(d, &t);
+            if (node >= 0) d->right[right_count++] = node;
+        } else {
+            break;
+        }
+        for (int i = 0; i < left_count; i++)
+            for (int j = 0; j < right_count; j++)
+                add_edge(d->p, d->left[i], d->right[j]);
+        memcpy(d->left, d->right, right_count * sizeof *d->left);
+        left_count = right_count;
+    }
+    if (dot_is(d, '[')) {
+        char label[MAX_NAME];
+        dot_next(d);
+        dot_attrs(d, label);
+    }
+}
+
+/* Statements are taken one by one, whatever graph or subgraph they sit
+ * in; only node and edge statements matter. */
+static void parse_dot(Parser *p) {
+    Dot *d = calloc(1, sizeof *d);
+    if (!d) return;
+    d->p = p;
+    char label[MAX_NAME];
+    for (;;) {
+        Token t = dot_next(d);
+        if (t.kind == TOK_EOF) break;
+        if (t.kind == TOK_PUNCT) {
+            if (t.punct == '{') {
+                if (d->depth < DOT_DEPTH) d->frame_len[d->depth] = 0;
+                d->depth++;
+            } else if (t.punct == '}' && d->depth > 0) {
+                int f = --d->depth;
+                if (f < DOT_DEPTH && dot_peek(d)->kind == TOK_EDGE) {
+                    memcpy(d->left, d->frame[f],
+                           d->frame_len[f] * sizeof *d->left);
+                    dot_edges(d, d->frame_len[f]);
+                }
+            } else if (t.punct == '[') {
+                dot_attrs(d, label);
+            }
+            continue;
+        }
+        if (keyword(&t, "node") || keyword(&t, "edge")
+            || keyword(&t, "graph") || keyword(&t, "digraph")
+            || keyword(&t, "strict") || keyword(&t, "subgraph")) {
+            if (dot_is(d, '[')) {
+                dot_next(d);
+                dot_attrs(d, label);
+            } else if (dot_peek(d)->kind == TOK_ID
+                       && !keyword(dot_peek(d), "graph")
+                       && !keyword(dot_peek(d), "digraph")) {
+                dot_next(d);    /* graph or subgraph name */
+            }
+            continue;
+        }
+        if (dot_is(d, '=')) {   /* graph attribute */
+            dot_next(d);
+            dot_next(d);
+            continue;
+        }
+        int node = dot_node(d, &t);
+        if (node < 0) continue;
+        if (dot_peek(d)->kind == TOK_EDGE) {
+            d->left[0] = node;
+            dot_edges(d, 1);
+        } else if (dot_is(d, '[')) {
+            dot_next(d);
+            if (dot_attrs(d, label)) dot_label(p, t.text, label);
+        }
+    }
+    free(d);
+}
+
+/* ---- JSON ---- */
+
+static int json_skip(Reader *r) {
+    int c;
+    while ((c = rd_getc(r)) != EOF && isspace(c)) {}
+    return c;
+}
+
+static void utf8_put(char *out, size_t size, size_t *len, unsigned cp) {
+    char buf[4];
+    int n = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+    if (n == 1) buf[0] = (char)cp;
+    else {
+        static const unsigned char lead[5] = {0, 0, 0xc0, 0xe0, 0xf0};
+        for (int i = n - 1; i > 0; i--, cp >>= 6)
+            buf[i] = (char)(0x80 | (cp & 0x3f));
+        buf[0] = (char)(lead[n] | cp);
+    }
+    if (*len + n < size) {
+        memcpy(out + *len, buf, n);
+        *len += n;
+    }
+}
+
+/* The rest of a string after its opening quote, truncated to size. */
+static bool json_string(Reader *r, char *out, size_t size) {
+    size_t len = 0;
+    int c;
+    while ((c = rd_getc(r)) != EOF && c != '"') {
+        if (c == '\\') {
+            c = rd_getc(r);
+            if (c == EOF) return false;
+            if (c == 'u') {
+                unsigned cp = 0;
+                for (int i = 0; i < 4; i++) {
+                    int h = rd_getc(r);
+                    if (!isxdigit(h)) return false;
+                    cp = cp * 16 + (isdigit(h) ? h - '0' : tolower(h) - 'a' + 10);
+                }
+                utf8_put(out, size, &len, cp);
+                continue;
+            }
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r'
+              : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+        }
+        if (len + 1 < size) out[len++] = (char)c;
+    }
+    out[len] = '\0';
+    return c == '"';
+}
+
+static bool is_key(const char *key, const char *a, const char *b,
+                   const char *c) {
+    return strcmp(key, a) == 0 || strcmp(key, b) == 0 || strcmp(key, c) == 0;
+}
+
+typedef enum { JSON_ERROR, JSON_OTHER, JSON_STRING } JsonKind;
+
+/*
+ * Any value starting with c; strings are copied to str. An edge is an
+ * array of exactly two strings, ["FROM", "TO"], or an object with from/to,
+ * source/target or src/dst string members. Only values in edge position
+ * count: a whole document (one JSON lines record), an element of a
+ * top-level array, or an element of an "edges" member at any depth. Pairs
+ * anywhere else, like tag lists, are left alone.
+ */
+static JsonKind json_value(Parser *p, int c, int depth, char *str,
+                           bool edge, bool list) {
+    Reader *r = &p->in;
+    char a[MAX_NAME], b[MAX_NAME], key[MAX_NAME], value[MAX_NAME];
+    bool has_a = false, has_b = false;
+    if (depth > JSON_DEPTH) return JSON_ERROR;
+
+    if (c == '"')
+        return json_string(r, str, MAX_NAME) ? JSON_STRING : JSON_ERROR;
+    if (c == '[') {
+        int n = 0, strings = 0;
+        if ((c = json_skip(r)) == ']') return JSON_OTHER;
+        for (;;) {
+            JsonKind kind = json_value(p, c, depth + 1, value, list, false);
+            if (kind == JSON_ERROR) return JSON_ERROR;
+            if (kind == JSON_STRING) {
+                if (n < 2) strcpy(n ? b : a, value);
+                strings++;
+            }
+            n++;
+            c = json_skip(r);
+            if (c == ']') break;
+            if (c != ',') return JSON_ERROR;
+            c = json_skip(r);
+        }
+        if (edge && n == 2 && strings == 2) add_named(p, a, b);
+        return JSON_OTHER;
+    }
+    if (c == '{') {
+        if ((c = json_skip(r)) == '}') return JSON_OTHER;
+        for (;;) {
+            if (c != '"' || !json_string(r, key, sizeof key)
+                || json_skip(r) != ':')
+                return JSON_ERROR;
+            JsonKind kind = json_value(p, json_skip(r), depth + 1, value,
+                                       false, strcmp(key, "edges") == 0);
+            if (kind == JSON_ERROR) return JSON_ERROR;
+            if (kind == JSON_STRING && is_key(key, "from", "source", "src")) {
+                strcpy(a, value);
+                has_a = true;
+            }
+            if (kind == JSON_STRING && is_key(key, "to", "target", "dst")) {
+                strcpy(b, value);
+                has_b = true;
+            }
+            c = json_skip(r);
+            if (c == '}') break;
+            if (c != ',') return JSON_ERROR;
+            c = json_skip(r);
+        }
+        if (edge && has_a && has_b) add_named(p, a, b);
+        return JSON_OTHER;
+    }
+    /* number, true, false or null */
+    if (c == EOF) return JSON_ERROR;
+    while ((c = rd_getc(r)) != EOF && !isspace(c)
+           && c != ',' && c != ']' && c != '}') {}
+    rd_ungetc(r, c);
+    return JSON_OTHER;
+}
+
+/* One document, or several in a row (JSON lines). */
+static void parse_json(Parser *p) {
+    char value[MAX_NAME];
+    int c;
+    while ((c = json_skip(&p->in)) != EOF)
+        if (json_value(p, c, 0, value, true, true) == JSON_ERROR) break;
+}
+
+/* ---- format detection ---- */
+
+/* Whether *s starts with the whole word kw, ended by a space or '{'; if
+ * so, *s moves past it and any spaces. */
+static bool dot_keyword(const char **s, const char *kw) {
+    size_t n = strlen(kw);
+    if (strncasecmp(*s, kw, n) != 0) return false;
+    unsigned char next = (*s)[n];
+    if (next != '{' && !isspace(next)) return false;
+    *s += n;
+    *s += strspn(*s, " \t\r\n");
+    return true;
+}
+
+/* "[strict] (graph|digraph) [ID] {", so edge lists whose first node is
+ * merely named like a keyword (graphql, strictly) stay edge lists. */
+static bool dot_header(const char *s) {
+    dot_keyword(&s, "strict");
+    if (!dot_keyword(&s, "digraph") && !dot_keyword(&s, "graph")) return false;
+    if (*s == '"') {
+        for (s++; *s && *s != '"'; s++)
+            if (*s == '\\' && s[1]) s++;
+        if (!*s++) return false;
+    } else if (*s == '<') {
+        int depth = 0;
+        do {
+            if (*s == '<') depth++;
+            else if (*s == '>') depth--;
+        } while (*s++ && depth > 0);
+        if (depth > 0) return false;
+    } else {
+        while (id_char((unsigned char)*s)) s++;
+    }
+    s += strspn(s, " \t\r\n");
+    return *s == '{';
+}
+
+static InputFormat sniff(const char *head) {
+    const char *s = head + strspn(head, " \t\r\n");
+    if (*s == '[' || *s == '{') return IN_JSON;
+    if (strncmp(s, "//", 2) == 0 || strncmp(s, "/*", 2) == 0) return IN_DOT;
+    if (dot_header(s)) return IN_DOT;
+    if (strstr(head, ": #deps ")) return IN_NINJA;
+    return IN_AUTO;             /* edges, or make -p found while reading */
+}
+
+/* ---- public API ---- */
+
+bool input_format(const char *name, InputFormat *fmt) {
+    static const char *names[] = {
+        [IN_AUTO] = "auto", [IN_EDGES] = "edges", [IN_DOT] = "dot",
+        [IN_NINJA] = "ninja", [IN_MAKE] = "make", [IN_JSON] = "json",
+    };
+    for (int i = 0; i < (int)(sizeof names / sizeof *names); i++)
+        if (strcmp(name, names[i]) == 0) {
+            *fmt = (InputFormat)i;
+            return true;
+        }
+    return false;
+}
+
+/*
+ * Build g from a whole input in the given format; IN_AUTO guesses it from
+ * the first few kilobytes, except make -p output, which is recognised by
+ * its data base header wherever that turns up. gzip and zstd input is decoded on the fly.
+ * Returns the number of edges read.
+ */
+int read_graph(FILE *fp, InputFormat fmt, Graph *g) {
+    Parser *p = calloc(1, sizeof *p);
+    if (!p) return 0;
+    graph_init(g);
+    p->g = g;
+    p->in.fp = fp;
+    p->in.head_len = fread(p->in.head, 1, HEAD_SIZE, fp);
+    Decoder *dec = NULL;
+    if (decoder_detect(p->in.head, p->in.head_len)) {
+        dec = decoder_start(fp, p->in.head, p->in.head_len, &p->in.fp);
+        if (!dec) {
+            fprintf(stderr, "Cannot start decompression\n");
+            free(p);
+            return 0;
+        }
+        p->in.head_len = fread(p->in.head, 1, HEAD_SIZE, p->in.fp);
+    }
+    p->in.head[p->in.head_len] = '\0';
+    if (fmt == IN_AUTO) fmt = sniff(p->in.head);
+
+    switch (fmt) {
+    case IN_DOT:   parse_dot(p);                  break;
+    case IN_NINJA: parse_ninja_deps(p);           break;
+    case IN_MAKE:  parse_make(p, false);          break;
+    case IN_JSON:  parse_json(p);                 break;
+    default:       parse_edges(p, fmt == IN_AUTO); break;
+    }
+
+    for (int i = 0; i < p->label_count; i++) {
+        int node = graph_find(g, p->label[i][0]);
+        if (node >= 0)
+            memcpy(g->nodes[node].name, p->label[i][1], MAX_NAME);
+    }
+    const char *error = dec ? decoder_finish(dec) : NULL;
+    if (error) fprintf(stderr, "%s\n", error);
+    if (p->dropped.count || p->dropped_edges)
+        fprintf(stderr, "Graph too large: dropped %zu nodes and %d edges "
+                "(limits: %d nodes, %d neighbours per node)\n",
+                p->dropped.count, p->dropped_edges, MAX_NODES, MAX_ADJ);
+    int edges = p->edges;
+    names_free(&p->dropped);
+    free(p->label);
+    free(p->in.line);
+    free(p);
+    return edges;
+}
+
 int default_edges(RawEdge *e) {
     static const char *d[][2] = {
         {"init","parse"},     {"init","config"},
@@ -0,0 +1,124 @@
+#include "drawdag.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- helpers ---- */
+
+/* Add n covered cells to the base block (bx, by) and every block above. */
+static void bump(Pyramid *p, int bx, int by, int n, bool lit) {
+    for (int l = 0; l < p->count; l++) {
+        PyrLevel *lv = &p->levels[l];
+        int idx = (by >> l) * lv->w + (bx >> l);
+        if (lit) lv->lit[idx] += n;
+        else     lv->occ[idx] += n;
+    }
+}
+
+/* Count the cells of an axis-aligned run into the base blocks it covers. */
+static void add_run(Pyramid *p, const Canvas *cv, int x0, int y0,
+                    int x1, int y1, int sign, bool lit) {
+    if (x0 > x1) { int swap = x0; x0 = x1; x1 = swap; }
+    if (y0 > y1) { int swap = y0; y0 = y1; y1 = swap; }
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= cv->width)  x1 = cv->width - 1;
+    if (y1 >= cv->height) y1 = cv->height - 1;
+    if (x0 > x1 || y0 > y1) return;
+
+    for (int by = y0 / PYR_BASE; by <= y1 / PYR_BASE; by++) {
+        int rows_lo = by * PYR_BASE > y0 ? by * PYR_BASE : y0;
+        int rows_hi = by * PYR_BASE + PYR_BASE - 1 < y1
+                      ? by * PYR_BASE + PYR_BASE - 1 : y1;
+        for (int bx = x0 / PYR_BASE; bx <= x1 / PYR_BASE; bx++) {
+            int cols_lo = bx * PYR_BASE > x0 ? bx * PYR_BASE : x0;
+            int cols_hi = bx * PYR_BASE + PYR_BASE - 1 < x1
+                          ? bx * PYR_BASE + PYR_BASE - 1 : x1;
+            bump(p, bx, by, sign * (rows_hi - rows_lo + 1)
+                                 * (cols_hi - cols_lo + 1), lit);
+        }
+    }
+}
+
+static void add_edge(Pyramid *p, const Canvas *cv, int edge, int sign,
+                     bool lit) {
+    for (int i = cv->ep_off[edge]; i < cv->ep_off[edge] + cv->ep_len[edge]; i++) {
+        const Seg *s = &cv->segs[i];
+        add_run(p, cv, s->x0, s->y0, s->x1, s->y1, sign, lit);
+    }
+}
+
+static void add_label(Pyramid *p, const Canvas *cv, int node, int sign,
+                      bool lit) {
+    add_run(p, cv, cv->bnd_xs[node], cv->bnd_y[node],
+            cv->bnd_xe[node], cv->bnd_y[node], sign, lit);
+}
+
+/* ---- public API ---- */
+
+/*
+ * Level 0 counts PYR_BASE x PYR_BASE blocks of canvas cells; each level
+ * above halves both sides, down to a single block.
+ */
+bool pyramid_build(Pyramid *p, const Canvas *cv) {
+    memset(p, 0, sizeof *p);
+    int w = (cv->width + PYR_BASE - 1) / PYR_BASE;
+    int h = (cv->height + PYR_BASE - 1) / PYR_BASE;
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    int count = 1;
+    for (int lw = w, lh = h; lw > 1 || lh > 1; count++) {
+        lw = (lw + 1) / 2;
+        lh = (lh + 1) / 2;
+    }
+
+    p->levels = calloc(count, sizeof *p->levels);
+    if (!p->levels) return false;
+    p->count = count;
+    for (int l = 0; l < count; l++) {
+        PyrLevel *lv = &p->levels[l];
+        lv->w = w;
+        lv->h = h;
+        lv->scale = PYR_BASE << l;
+        lv->occ = calloc((size_t)w * h, sizeof *lv->occ);
+        lv->lit = calloc((size_t)w * h, sizeof *lv->lit);
+        if (!lv->occ || !lv->lit) { pyramid_free(p); return false; }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    for (int e = 0; e < cv->ep_count; e++) add_edge(p, cv, e, 1, false);
+    for (int i = 0; i < cv->g->count; i++)
+        if (cv->has_bnd[i]) add_label(p, cv, i, 1, false);
+    pyramid_light(p, cv, 1);
+    return true;
+}
+
+/* Add (sign = 1) or remove (sign = -1) the current canvas highlight.
+ * Called around canvas_select; only the lit edges and labels it listed
+ * are walked. */
+void pyramid_light(Pyramid *p, const Canvas *cv, int sign) {
+    if (!p->levels) return;
+    for (int i = 0; i < cv->ep_lit_count; i++)
+        add_edge(p, cv, cv->ep_lit[i], sign, true);
+    for (int i = 0; i < cv->node_lit_count; i++)
+        if (cv->has_bnd[cv->node_lit[i]])
+            add_label(p, cv, cv->node_lit[i], sign, true);
+}
+
+/* Finest level that fits in a max_w x max_h pane. */
+int pyramid_pick(const Pyramid *p, int max_w, int max_h) {
+    for (int l = 0; l < p->count; l++)
+        if (p->levels[l].w <= max_w && p->levels[l].h <= max_h) return l;
+    return p->count - 1;
+}
+
+void pyramid_free(Pyramid *p) {
+    for (int l = 0; l < p->count; l++) {
+        free(p->levels[l].occ);
+        free(p->levels[l].lit);
+    }
+    free(p->levels);
+    p->levels = NULL;
+    p->count = 0;
+}
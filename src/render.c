@@ -6,72 +6,8 @@
 
 /* ---- helpers ---- */
 
-static void mark_edge_path(bool *highlight, const Canvas *cv,
-                           int src, int dst) {
-    for (int e = 0; e < cv->ep_count; e++) {
-        if (cv->ep_src[e] == src && cv->ep_dst[e] == dst) {
-            for (int p = 0; p < cv->ep_len[e]; p++) {
-                int row = cv->pr[cv->ep_off[e] + p];
-                int col = cv->pc[cv->ep_off[e] + p];
-                highlight[row * cv->width + col] = true;
-            }
-            break;
-        }
-    }
-}
-
-static void compute_highlight(bool *highlight, const Canvas *cv,
-                              const Graph *g, int selected) {
-    memset(highlight, 0, cv->width * cv->height * sizeof *highlight);
-    if (selected < 0) return;
-
-    bool connected[MAX_NODES] = {0};
-    bool visited[MAX_NODES];
-    int stack[MAX_NODES];
-    int stack_top;
-
-    /* forward traversal */
-    stack_top = 0; memset(visited, 0, sizeof visited);
-    stack[stack_top++] = selected;
-    while (stack_top > 0) {
-        int node = stack[--stack_top];
-        if (visited[node]) continue;
-        visited[node] = true;
-        for (int i = 0; i < g->nodes[node].out_count; i++) {
-            int neighbor = g->nodes[node].adj_out[i];
-            mark_edge_path(highlight, cv, node, neighbor);
-            if (g->nodes[neighbor].is_dummy) stack[stack_top++] = neighbor;
-            else                             connected[neighbor] = true;
-        }
-    }
-
-    /* backward traversal */
-    stack_top = 0; memset(visited, 0, sizeof visited);
-    stack[stack_top++] = selected;
-    while (stack_top > 0) {
-        int node = stack[--stack_top];
-        if (visited[node]) continue;
-        visited[node] = true;
-        for (int i = 0; i < g->nodes[node].in_count; i++) {
-            int neighbor = g->nodes[node].adj_in[i];
-            mark_edge_path(highlight, cv, neighbor, node);
-            if (g->nodes[neighbor].is_dummy) stack[stack_top++] = neighbor;
-            else                             connected[neighbor] = true;
-        }
-    }
-
-    /* highlight connected node labels */
-    for (int i = 0; i < g->count; i++) {
-        if (!connected[i] || !cv->has_bnd[i]) continue;
-        int row = cv->bnd_y[i];
-        for (int x = cv->bnd_xs[i]; x <= cv->bnd_xe[i]; x++)
-            if (x >= 0 && x < cv->width)
-                highlight[row * cv->width + x] = true;
-    }
-}
-
-static void render(WINDOW *win, const Canvas *cv, const bool *highlight,
-                   int selected, int scroll_x, int scroll_y) {
+static void render(WINDOW *win, Canvas *cv, int selected,
+                   int scroll_x, int scroll_y) {
     int max_row, max_col;
     getmaxyx(win, max_row, max_col);
     int draw_width = max_col - DRAW_MARGIN;
@@ -84,11 +20,11 @@ static void render(WINDOW *win, const Canvas *cv, const bool *highlight,
         for (int screen_col = 0; screen_col < draw_width; screen_col++) {
             int canvas_col = scroll_x + screen_col;
             if (canvas_col >= cv->width) break;
-            wchar_t ch = cv->cells[canvas_row * cv->width + canvas_col];
+            bool lit;
+            wchar_t ch = canvas_cell(cv, canvas_col, canvas_row, &lit);
             attr_t attr;
             short pair;
-            if (highlight[canvas_row * cv->width + canvas_col])
-                                     { attr = A_BOLD;   pair = 2; }
+            if (lit)                 { attr = A_BOLD;   pair = 2; }
             else if (ch != L' ')     { attr = A_NORMAL; pair = 1; }
             else                     { attr = A_NORMAL; pair = 0; }
             wstr[0] = ch;
@@ -105,7 +41,7 @@ static void render(WINDOW *win, const Canvas *cv, const bool *highlight,
             for (int x = cv->bnd_xs[selected]; x <= cv->bnd_xe[selected]; x++) {
                 int screen_x = x - scroll_x;
                 if (screen_x >= 0 && screen_x < draw_width) {
-                    wstr[0] = cv->cells[row * cv->width + x];
+                    wstr[0] = canvas_cell(cv, x, row, NULL);
                     setcchar(&cch, wstr, A_REVERSE, 2, NULL);
                     mvadd_wch(screen_y, screen_x, &cch);
                 }
@@ -123,6 +59,80 @@ static int find_clicked(const Canvas *cv, int node_count,
     return -1;
 }
 
+/* ---- minimap ---- */
+
+static const wchar_t SHADE[5] = {
+    L' ', L'\u2591', L'\u2592', L'\u2593', L'\u2588',
+};
+
+typedef struct {
+    int x, y, w, h;         /* inner area, excluding the frame */
+    int level;              /* pyramid level shown */
+} Pane;
+
+/* Top-right pane sized to the finest pyramid level that fits. */
+static bool minimap_pane(const Pyramid *pyr, int max_row, int max_col,
+                         Pane *pane) {
+    int avail_w = max_col - DRAW_MARGIN - 2, avail_h = max_row - 2;
+    if (avail_w > MINIMAP_W) avail_w = MINIMAP_W;
+    if (avail_h > MINIMAP_H) avail_h = MINIMAP_H;
+    if (!pyr->levels || avail_w < 1 || avail_h < 1) return false;
+    pane->level = pyramid_pick(pyr, avail_w, avail_h);
+    pane->w = pyr->levels[pane->level].w;
+    pane->h = pyr->levels[pane->level].h;
+    pane->x = max_col - DRAW_MARGIN - pane->w - 1;
+    pane->y = 1;
+    return true;
+}
+
+static void put_cell(int row, int col, wchar_t ch, attr_t attr, short pair) {
+    cchar_t cch;
+    wchar_t wstr[2] = {ch, 0};
+    setcchar(&cch, wstr, attr, pair, NULL);
+    mvadd_wch(row, col, &cch);
+}
+
+static void render_minimap(const Pyramid *pyr, const Pane *pane,
+                           int scroll_x, int scroll_y,
+                           int view_w, int view_h) {
+    const PyrLevel *lv = &pyr->levels[pane->level];
+    int area = lv->scale * lv->scale;
+
+    /* frame */
+    for (int x = -1; x <= pane->w; x++) {
+        uint8_t top = DIR_E | DIR_W, bottom = DIR_E | DIR_W;
+        if (x == -1)      { top = DIR_S | DIR_E; bottom = DIR_N | DIR_E; }
+        if (x == pane->w) { top = DIR_S | DIR_W; bottom = DIR_N | DIR_W; }
+        put_cell(pane->y - 1, pane->x + x, CONNECTOR[top], A_NORMAL, 1);
+        put_cell(pane->y + pane->h, pane->x + x, CONNECTOR[bottom],
+                 A_NORMAL, 1);
+    }
+    for (int y = 0; y < pane->h; y++) {
+        put_cell(pane->y + y, pane->x - 1, CONNECTOR[DIR_N | DIR_S],
+                 A_NORMAL, 1);
+        put_cell(pane->y + y, pane->x + pane->w, CONNECTOR[DIR_N | DIR_S],
+                 A_NORMAL, 1);
+    }
+
+    /* density, highlight and viewport outline */
+    int vx0 = scroll_x / lv->scale, vx1 = (scroll_x + view_w - 1) / lv->scale;
+    int vy0 = scroll_y / lv->scale, vy1 = (scroll_y + view_h - 1) / lv->scale;
+    for (int y = 0; y < pane->h; y++)
+        for (int x = 0; x < pane->w; x++) {
+            int occ = lv->occ[y * lv->w + x], lit = lv->lit[y * lv->w + x];
+            int shade = occ == 0          ? 0
+                      : occ * 8 < area    ? 1
+                      : occ * 4 < area    ? 2
+                      : occ * 2 < area    ? 3 : 4;
+            attr_t attr = lit ? A_BOLD : A_NORMAL;
+            bool outline = x >= vx0 && x <= vx1 && y >= vy0 && y <= vy1
+                           && (x == vx0 || x == vx1 || y == vy0 || y == vy1);
+            if (outline) attr |= A_REVERSE;
+            put_cell(pane->y + y, pane->x + x, SHADE[shade], attr,
+                     lit ? 2 : 1);
+        }
+}
+
 /* ---- setup ---- */
 
 static void render_setup(mmask_t *scroll_up, mmask_t *scroll_down) {
@@ -149,13 +159,19 @@ static void render_setup(mmask_t *scroll_up, mmask_t *scroll_down) {
 
 /* ---- public API ---- */
 
-void event_loop(const Graph *g, const Canvas *cv) {
+/* Runs until the user quits, or asks to expand/collapse the selected node
+ * (VIEW_TOGGLE), in which case the caller relayouts and calls back in. */
+ViewAction event_loop(const Graph *g, Canvas *cv, ViewState *vs) {
     mmask_t scroll_up_mask, scroll_down_mask;
     render_setup(&scroll_up_mask, &scroll_down_mask);
 
-    int scroll_x = 0, scroll_y = 0, selected = -1;
-    bool *highlight = calloc(cv->width * cv->height, sizeof *highlight);
-    if (!highlight) return;
+    int scroll_x = vs->scroll_x, scroll_y = vs->scroll_y;
+    int selected = vs->selected, shown = -1;
+    bool show_minimap = vs->show_minimap;
+    ViewAction action = VIEW_QUIT;
+    Pyramid pyr = {0};
+    Pane pane = {0};
+    if (show_minimap) pyramid_build(&pyr, cv);
 
     for (;;) {
         int term_rows, term_cols;
@@ -169,14 +185,32 @@ void event_loop(const Graph *g, const Canvas *cv) {
         if (scroll_y < 0) scroll_y = 0;
         if (scroll_y > max_scroll_y) scroll_y = max_scroll_y;
 
-        compute_highlight(highlight, cv, g, selected);
+        if (selected != shown) {
+            pyramid_light(&pyr, cv, -1);
+            canvas_select(cv, selected);
+            pyramid_light(&pyr, cv, 1);
+            shown = selected;
+        }
         erase();
-        render(stdscr, cv, highlight, selected, scroll_x, scroll_y);
+        render(stdscr, cv, selected, scroll_x, scroll_y);
+        bool pane_shown = show_minimap
+                          && minimap_pane(&pyr, term_rows, term_cols, &pane);
+        if (pane_shown)
+            render_minimap(&pyr, &pane, scroll_x, scroll_y,
+                           term_cols - DRAW_MARGIN, term_rows - DRAW_MARGIN);
         refresh();
 
         int key = getch();
         if (key == 'q' || key == 'Q') break;
         else if (key == ' ')                            selected = -1;
+        else if ((key == 'e' || key == '\n') && selected >= 0) {
+            action = VIEW_TOGGLE;
+            break;
+        }
+        else if (key == 'm') {
+            show_minimap = !show_minimap;
+            if (show_minimap && !pyr.levels) pyramid_build(&pyr, cv);
+        }
         else if (key == KEY_LEFT  || key == 'a')        scroll_x -= SCROLL_STEP;
         else if (key == KEY_RIGHT || key == 'd')        scroll_x += SCROLL_STEP;
         else if (key == KEY_UP    || key == 'z')        scroll_y -= SCROLL_STEP;
@@ -188,7 +222,16 @@ void event_loop(const Graph *g, const Canvas *cv) {
                     scroll_y -= SCROLL_STEP;
                 else if (scroll_down_mask && (mouse.bstate & scroll_down_mask))
                     scroll_y += SCROLL_STEP;
-                else if (mouse.bstate & BUTTON1_CLICKED) {
+                else if ((mouse.bstate & BUTTON1_CLICKED) && pane_shown
+                         && mouse.x >= pane.x && mouse.x < pane.x + pane.w
+                         && mouse.y >= pane.y && mouse.y < pane.y + pane.h) {
+                    /* centre the viewport on the clicked overview cell */
+                    int scale = pyr.levels[pane.level].scale;
+                    scroll_x = (mouse.x - pane.x) * scale + scale / 2
+                               - (term_cols - DRAW_MARGIN) / 2;
+                    scroll_y = (mouse.y - pane.y) * scale + scale / 2
+                               - (term_rows - DRAW_MARGIN) / 2;
+                } else if (mouse.bstate & BUTTON1_CLICKED) {
                     int clicked = find_clicked(cv, g->count,
                                               mouse.x + scroll_x,
                                               mouse.y + scroll_y);
@@ -197,5 +240,10 @@ void event_loop(const Graph *g, const Canvas *cv) {
             }
         }
     }
-    free(highlight);
+    pyramid_free(&pyr);
+    vs->scroll_x = scroll_x;
+    vs->scroll_y = scroll_y;
+    vs->selected = selected;
+    vs->show_minimap = show_minimap;
+    return action;
 }
@@ -0,0 +1,691 @@
+#include "drawdag.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Protocol, one request after another on a connection:
+ *
+ *   PUT NAME [text|coords]     edge lines "FROM TO", then a "." line
+ *   PATCH NAME [text|coords]   lines "+ FROM TO" / "- FROM TO", then "."
+ *   GET NAME [text|coords]
+ *   DROP NAME
+ *
+ * Each request is answered with "OK LEN\n" and LEN bytes of drawing, or
+ * with a single "ERR MESSAGE\n" line. Connections are polled by one
+ * dispatcher thread that queues complete requests for the worker pool.
+ */
+
+#define READ_CHUNK   4096
+#define REQUEST_MAX  (4 << 20)  /* well above a full PUT body */
+
+typedef enum { FMT_TEXT, FMT_COORDS } Format;
+
+/* A named graph with its last layout. */
+typedef struct {
+    bool live;
+    char name[MAX_NAME];
+    RawEdge *edges;
+    int edge_count;
+    unsigned long version;  /* bumped on every change */
+    unsigned long used;     /* LRU stamp */
+    /* horizontal positions from the last layout, to seed the next one */
+    char (*hint_name)[MAX_NAME];
+    double *hint_pos;
+    int hint_count;
+    char *out[2];           /* rendered text and coordinates, if current */
+    size_t out_len[2];
+} Entry;
+
+/* A client connection. Its buffer is only touched by the dispatcher,
+ * or by the one worker serving its request while it is busy. */
+typedef struct Conn {
+    int fd;
+    char *buf;              /* unread input, NUL-terminated */
+    size_t len, cap;
+    size_t req_len;         /* the request at the front being served */
+    bool busy, eof, dead;
+    /* set by the worker, read after the done queue hands it back */
+    struct Conn *next;      /* in the work or done queue */
+    bool failed;
+} Conn;
+
+typedef struct {
+    const ServeOptions *opt;
+    int listen_fd;
+    pthread_mutex_t lock;
+    Entry *cache;
+    unsigned long tick, versions;
+    /* requests waiting for a worker, and answered ones going back */
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queued;
+    Conn *work, *work_tail, *done;
+    int wake[2];            /* pipe that tells the dispatcher about done */
+} Server;
+
+/* Per-worker buffers, too big for a thread stack. */
+typedef struct {
+    RawEdge body[MAX_EDGES];
+    char sign[MAX_EDGES];
+    RawEdge edges[MAX_EDGES];
+    const char *node[MAX_NODES];
+    char hint_name[MAX_NODES][MAX_NAME];
+    double hint_pos[MAX_NODES];
+    Graph g;
+    Canvas cv;
+    double hint[MAX_NODES];
+    double pos[MAX_NODES];
+} Scratch;
+
+/* ---- helpers ---- */
+
+static bool send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool reply(int fd, const char *payload, size_t len) {
+    char head[32];
+    int n = snprintf(head, sizeof head, "OK %zu\n", len);
+    return send_all(fd, head, n) && send_all(fd, payload, len);
+}
+
+static bool reply_err(int fd, const char *msg) {
+    char line[128];
+    int n = snprintf(line, sizeof line, "ERR %s\n", msg);
+    return send_all(fd, line, n);
+}
+
+static bool same_edge(const RawEdge *a, const RawEdge *b) {
+    return strcmp(a->src, b->src) == 0 && strcmp(a->dst, b->dst) == 0;
+}
+
+static void entry_invalidate(Entry *e) {
+    for (int f = 0; f < 2; f++) {
+        free(e->out[f]);
+        e->out[f] = NULL;
+    }
+}
+
+static void entry_clear(Entry *e) {
+    entry_invalidate(e);
+    free(e->edges);
+    free(e->hint_name);
+    free(e->hint_pos);
+    memset(e, 0, sizeof *e);
+}
+
+static Entry *entry_find(Server *srv, const char *name) {
+    for (int i = 0; i < srv->opt->cache; i++)
+        if (srv->cache[i].live && strcmp(srv->cache[i].name, name) == 0)
+            return &srv->cache[i];
+    return NULL;
+}
+
+/* A free slot, or the least recently used one emptied. */
+static Entry *entry_new(Server *srv, const char *name) {
+    Entry *e = &srv->cache[0];
+    for (int i = 0; i < srv->opt->cache; i++) {
+        if (!srv->cache[i].live) { e = &srv->cache[i]; break; }
+        if (srv->cache[i].used < e->used) e = &srv->cache[i];
+    }
+    entry_clear(e);
+    e->live = true;
+    snprintf(e->name, sizeof e->name, "%s", name);
+    e->edges = malloc(MAX_EDGES * sizeof *e->edges);
+    if (!e->edges) { e->live = false; return NULL; }
+    return e;
+}
+
+/* Whether the n edges in s->edges name more than MAX_NODES nodes. */
+static bool too_many_nodes(Scratch *s, int n) {
+    int count = 0;
+    for (int i = 0; i < 2 * n; i++) {
+        const char *name = i % 2 ? s->edges[i / 2].dst : s->edges[i / 2].src;
+        int j = 0;
+        while (j < count && strcmp(s->node[j], name) != 0) j++;
+        if (j < count) continue;
+        if (count == MAX_NODES) return true;
+        s->node[count++] = name;
+    }
+    return false;
+}
+
+/* Apply a PUT body (sign 0) or PATCH lines to a copy of the entry's
+ * edges in s->edges; e is NULL for a name not cached yet. Returns the
+ * new edge count, -1 past MAX_EDGES or -2 past MAX_NODES, and sets
+ * *changed. Called with the lock held. */
+static int entry_apply(const Entry *e, Scratch *s, int count, bool replace,
+                       bool *changed) {
+    *changed = replace;
+    int n = replace || !e ? 0 : e->edge_count;
+    if (n) memcpy(s->edges, e->edges, n * sizeof *s->edges);
+    for (int i = 0; i < count; i++) {
+        int found = -1;
+        if (!replace || s->sign[i])
+            for (int j = 0; j < n && found < 0; j++)
+                if (same_edge(&s->edges[j], &s->body[i])) found = j;
+        if (s->sign[i] == '-') {
+            if (found < 0) continue;
+            s->edges[found] = s->edges[--n];
+            *changed = true;
+        } else if (found < 0) {
+            if (n == MAX_EDGES) return -1;
+            s->edges[n++] = s->body[i];
+            *changed = true;
+        }
+    }
+    if (*changed && too_many_nodes(s, n)) return -2;
+    return n;
+}
+
+/* ---- layout ---- */
+
+/* Lay out the edges copied to s->edges, seeded with the positions the
+ * same node names had last time, if any. */
+static char *render(Scratch *s, int edge_count, int hint_count,
+                    const ServeOptions *opt, Format fmt, size_t *len) {
+    Graph *g = &s->g;
+    graph_from_edges(g, s->edges, edge_count);
+    if (opt->reduce) graph_transitive_reduce(g);
+    for (int i = 0; i < g->count; i++) {
+        s->hint[i] = -1;
+        for (int j = 0; j < hint_count; j++)
+            if (strcmp(s->hint_name[j], g->nodes[i].name) == 0) {
+                s->hint[i] = s->hint_pos[j];
+                break;
+            }
+    }
+    const double *hint = hint_count > 0 ? s->hint : NULL;
+
+    Arena arena;
+    arena_init(&arena, sugiyama_arena_size(g), NULL);
+    Layout lay;
+    if (!sugiyama(&arena, g, hint, NULL, &lay)) {
+        arena_free(&arena);
+        return NULL;
+    }
+    layout_positions(g, &lay, s->pos);
+    memset(&s->cv, 0, sizeof s->cv);
+    build_canvas(&s->cv, &arena, g, &lay,
+                 canvas_compute_width(g, &lay, opt->max_width));
+
+    char *buf = NULL;
+    FILE *out = open_memstream(&buf, len);
+    if (out) {
+        const Canvas *cv = &s->cv;
+        if (fmt == FMT_TEXT) {
+            canvas_print(cv, out);
+        } else {
+            fprintf(out, "size %d %d\n", cv->width, cv->height);
+            for (int i = 0; i < g->count; i++)
+                fprintf(out, "node %d %d %d %d %d %s\n", i, cv->node_col[i],
+                        cv->node_row[i], cv->bnd_xs[i], cv->bnd_xe[i],
+                        g->nodes[i].name);
+            for (int i = 0; i < cv->seg_count; i++) {
+                const Seg *seg = &cv->segs[i];
+                fprintf(out, "seg %d %d %d %d %d %d\n", cv->ep_src[seg->edge],
+                        cv->ep_dst[seg->edge], seg->x0, seg->y0,
+                        seg->x1, seg->y1);
+            }
+        }
+        fclose(out);
+    }
+    canvas_free(&s->cv);
+    arena_free(&arena);
+    return buf;
+}
+
+/* Keep the new positions by node name for the next change of the graph.
+ * Called with the lock held. */
+static void entry_keep_hints(Entry *e, const Graph *g, const double *pos) {
+    free(e->hint_name);
+    free(e->hint_pos);
+    e->hint_name = malloc((g->count + 1) * sizeof *e->hint_name);
+    e->hint_pos = malloc((g->count + 1) * sizeof *e->hint_pos);
+    e->hint_count = 0;
+    if (!e->hint_name || !e->hint_pos) return;
+    for (int i = 0; i < g->count; i++) {
+        memcpy(e->hint_name[i], g->nodes[i].name, MAX_NAME);
+        e->hint_pos[i] = pos[i];
+    }
+    e->hint_count = g->count;
+}
+
+/* ---- requests ---- */
+
+/* Body lines up to ".", as edges; PATCH lines carry a leading sign.
+ * Returns the line count, -1 at end of input, or -2 past MAX_EDGES once
+ * the whole body has been read. */
+static int read_body(FILE *in, Scratch *s, bool patch) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    int n = 0;
+    bool overflow = false;
+    while (getline(&line, &line_cap, in) >= 0) {
+        char *p = line + strspn(line, " \t");
+        if (p[0] == '.' && (p[1] == '\n' || p[1] == '\r' || !p[1])) {
+            free(line);
+            return overflow ? -2 : n;
+        }
+        if (*p == '#' || *p == '\n' || *p == '\r' || !*p) continue;
+        char sign = 0;
+        if (patch) {
+            if (*p != '+' && *p != '-') continue;
+            sign = *p++;
+        }
+        if (n == MAX_EDGES) {
+            overflow = true;
+            continue;
+        }
+        if (sscanf(p, "%63s %63s", s->body[n].src, s->body[n].dst) == 2)
+            s->sign[n++] = sign;
+    }
+    free(line);
+    return -1;
+}
+
+static bool handle(Server *srv, int fd, FILE *in, const char *line,
+                   Scratch *s) {
+    char verb[16], name[MAX_NAME], fmt_name[16] = "text";
+    if (sscanf(line, "%15s %63s %15s", verb, name, fmt_name) < 2)
+        return reply_err(fd, "bad request");
+    Format fmt = strcmp(fmt_name, "coords") == 0 ? FMT_COORDS : FMT_TEXT;
+    bool put = strcmp(verb, "PUT") == 0, patch = strcmp(verb, "PATCH") == 0;
+
+    int body = 0;
+    if (put || patch) {
+        body = read_body(in, s, patch);
+        if (body == -2) return reply_err(fd, "too many edges");
+        if (body < 0) return false;
+    } else if (strcmp(verb, "DROP") == 0) {
+        pthread_mutex_lock(&srv->lock);
+        Entry *e = entry_find(srv, name);
+        if (e) entry_clear(e);
+        pthread_mutex_unlock(&srv->lock);
+        return e ? reply(fd, "", 0) : reply_err(fd, "unknown graph");
+    } else if (strcmp(verb, "GET") != 0) {
+        return reply_err(fd, "unknown command");
+    }
+
+    /* update the entry and take what the layout needs; a new name gets a
+     * cache slot only once it has edges that fit */
+    pthread_mutex_lock(&srv->lock);
+    Entry *e = entry_find(srv, name);
+    const char *error = NULL;
+    if (put || patch) {
+        bool changed;
+        int n = entry_apply(e, s, body, put, &changed);
+        if (n == -1) error = "too many edges";
+        else if (n == -2) error = "too many nodes";
+        else if (!e && n == 0) error = put ? "no edges" : "unknown graph";
+        else if (!e && !(e = entry_new(srv, name))) error = "out of memory";
+        else if (changed) {
+            memcpy(e->edges, s->edges, n * sizeof *e->edges);
+            e->edge_count = n;
+            e->version = ++srv->versions;
+            entry_invalidate(e);
+        }
+    } else if (!e) {
+        error = "unknown graph";
+    }
+    if (error) {
+        pthread_mutex_unlock(&srv->lock);
+        return reply_err(fd, error);
+    }
+    e->used = ++srv->tick;
+    char *out = NULL;
+    size_t len = e->out_len[fmt];
+    if (e->out[fmt] && (out = malloc(len + 1)))
+        memcpy(out, e->out[fmt], len);
+    int edge_count = e->edge_count, hint_count = e->hint_count;
+    unsigned long version = e->version;
+    if (!out) {
+        memcpy(s->edges, e->edges, edge_count * sizeof *s->edges);
+        if (hint_count) {
+            memcpy(s->hint_name, e->hint_name,
+                   hint_count * sizeof *s->hint_name);
+            memcpy(s->hint_pos, e->hint_pos, hint_count * sizeof *s->hint_pos);
+        }
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    if (!out) {
+        if (edge_count == 0) return reply_err(fd, "no edges");
+        out = render(s, edge_count, hint_count, srv->opt, fmt, &len);
+        if (!out) return reply_err(fd, "out of memory");
+
+        /* keep the result unless the graph changed in the meantime */
+        pthread_mutex_lock(&srv->lock);
+        e = entry_find(srv, name);
+        if (e && e->version == version) {
+            entry_keep_hints(e, &s->g, s->pos);
+            free(e->out[fmt]);
+            e->out[fmt] = malloc(len + 1);
+            if (e->out[fmt]) memcpy(e->out[fmt], out, len);
+            e->out_len[fmt] = len;
+        }
+        pthread_mutex_unlock(&srv->lock);
+    }
+    bool ok = reply(fd, out, len);
+    free(out);
+    return ok;
+}
+
+/* ---- connections ---- */
+
+/* Input not yet served, with the request being served at the front. */
+static bool conn_read(Conn *c) {
+    if (c->cap - c->len < READ_CHUNK + 1) {
+        size_t cap = c->cap ? 2 * c->cap : 2 * READ_CHUNK;
+        char *buf = realloc(c->buf, cap);
+        if (!buf) return false;
+        c->buf = buf;
+        c->cap = cap;
+    }
+    ssize_t n = recv(c->fd, c->buf + c->len, c->cap - c->len - 1,
+                     MSG_DONTWAIT);
+    if (n > 0) {
+        c->len += n;
+        c->buf[c->len] = '\0';
+    } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+                          && errno != EINTR)) {
+        c->eof = true;
+    }
+    return true;
+}
+
+/* Bytes of blank lines at the start of buf. */
+static size_t blank_prefix(const char *buf, size_t len) {
+    size_t at = 0;
+    const char *nl;
+    while ((nl = memchr(buf + at, '\n', len - at))) {
+        const char *p = buf + at + strspn(buf + at, " \t\r");
+        if (p != nl) break;
+        at = nl - buf + 1;
+    }
+    return at;
+}
+
+/* Length of the complete request at the start of buf, or 0: its header
+ * line and, for PUT and PATCH, every line up to the "." one. */
+static size_t request_end(const char *buf, size_t len) {
+    const char *nl = memchr(buf, '\n', len);
+    if (!nl) return 0;
+    size_t at = nl - buf + 1;
+    char verb[16];
+    if (sscanf(buf, "%15s", verb) != 1
+        || (strcmp(verb, "PUT") != 0 && strcmp(verb, "PATCH") != 0))
+        return at;
+    while ((nl = memchr(buf + at, '\n', len - at))) {
+        const char *p = buf + at + strspn(buf + at, " \t");
+        at = nl - buf + 1;
+        if (p[0] == '.' && (p[1] == '\n' || p[1] == '\r')) return at;
+    }
+    return 0;
+}
+
+/* Hand the next buffered request of an idle connection to the workers.
+ * Returns false once the connection should be closed. */
+static bool conn_next(Server *srv, Conn *c) {
+    size_t skip = blank_prefix(c->buf, c->len);
+    memmove(c->buf, c->buf + skip, c->len - skip + 1);
+    c->len -= skip;
+    c->req_len = request_end(c->buf, c->len);
+    if (c->req_len == 0) {
+        if (c->len > REQUEST_MAX) {
+            reply_err(c->fd, "request too large");
+            return false;
+        }
+        return !c->eof;
+    }
+    c->busy = true;
+    pthread_mutex_lock(&srv->queue_lock);
+    c->next = NULL;
+    if (srv->work_tail) srv->work_tail->next = c;
+    else                srv->work = c;
+    srv->work_tail = c;
+    pthread_cond_signal(&srv->queued);
+    pthread_mutex_unlock(&srv->queue_lock);
+    return true;
+}
+
+static void conn_close(Conn *c) {
+    close(c->fd);
+    free(c->buf);
+    free(c);
+}
+
+/* ---- threads ---- */
+
+/* Workers take one request at a time off the queue, whichever
+ * connection it came from. */
+static void *worker(void *arg) {
+    Server *srv = arg;
+    Scratch *s = malloc(sizeof *s);
+    if (!s) return NULL;
+    char *line = NULL;
+    size_t line_cap = 0;
+    for (;;) {
+        pthread_mutex_lock(&srv->queue_lock);
+        while (!srv->work) pthread_cond_wait(&srv->queued, &srv->queue_lock);
+        Conn *c = srv->work;
+        if (!(srv->work = c->next)) srv->work_tail = NULL;
+        pthread_mutex_unlock(&srv->queue_lock);
+
+        FILE *in = fmemopen(c->buf, c->req_len, "r");
+        bool ok = in && getline(&line, &line_cap, in) > 0
+                  && handle(srv, c->fd, in, line, s);
+        if (in) fclose(in);
+
+        pthread_mutex_lock(&srv->queue_lock);
+        c->failed = !ok;
+        c->next = srv->done;
+        srv->done = c;
+        pthread_mutex_unlock(&srv->queue_lock);
+        char byte = 0;
+        while (write(srv->wake[1], &byte, 1) < 0 && errno == EINTR) {}
+    }
+    return NULL;
+}
+
+/*
+ * One thread watches the listening socket and every idle connection, and
+ * queues each complete request for the workers. A connection is left out
+ * of the poll set while one of its requests is being served, so replies
+ * keep the order of the requests, and an idle client costs no worker.
+ */
+static void *dispatch(void *arg) {
+    Server *srv = arg;
+    Conn **conns = NULL;
+    struct pollfd *pfd = NULL;
+    int count = 0, cap = 0;
+    for (;;) {
+        /* connections whose request has been answered */
+        pthread_mutex_lock(&srv->queue_lock);
+        Conn *done = srv->done;
+        srv->done = NULL;
+        pthread_mutex_unlock(&srv->queue_lock);
+        while (done) {
+            Conn *c = done;
+            done = c->next;
+            c->busy = false;
+            c->len -= c->req_len;
+            memmove(c->buf, c->buf + c->req_len, c->len + 1);
+            if (c->failed || !conn_next(srv, c)) c->dead = true;
+        }
+        for (int i = 0; i < count; i++)
+            if (conns[i]->dead && !conns[i]->busy) {
+                conn_close(conns[i]);
+                conns[i--] = conns[--count];
+            }
+
+        /* listening socket, wake pipe, then the idle connections */
+        if (count + 2 > cap) {
+            int grown = 2 * (count + 2);
+            Conn **c = realloc(conns, grown * sizeof *conns);
+            if (c) conns = c;
+            struct pollfd *p = realloc(pfd, (grown + 2) * sizeof *pfd);
+            if (p) pfd = p;
+            if (!c || !p) break;
+            cap = grown;
+        }
+        pfd[0] = (struct pollfd){.fd = srv->listen_fd, .events = POLLIN};
+        pfd[1] = (struct pollfd){.fd = srv->wake[0], .events = POLLIN};
+        int polled = 2;
+        for (int i = 0; i < count; i++)
+            if (!conns[i]->busy && !conns[i]->dead)
+                pfd[polled++] = (struct pollfd){.fd = conns[i]->fd,
+                                                .events = POLLIN};
+        if (poll(pfd, polled, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        char drain[64];
+        if (pfd[1].revents)
+            while (read(srv->wake[0], drain, sizeof drain) > 0) {}
+        for (int i = 0, k = 2; i < count; i++) {
+            Conn *c = conns[i];
+            if (c->busy || c->dead || !pfd[k++].revents) continue;
+            if (!conn_read(c) || !conn_next(srv, c)) c->dead = true;
+        }
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(srv->listen_fd, NULL, NULL);
+            Conn *c = fd >= 0 ? calloc(1, sizeof *c) : NULL;
+            if (c) {
+                c->fd = fd;
+                conns[count++] = c;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    fprintf(stderr, "Out of memory\n");
+    kill(getpid(), SIGTERM);    /* wake serve_run to shut down */
+    return NULL;
+}
+
+/*
+ * Make room for the socket at addr: nothing there is fine, and a socket
+ * nobody answers on is left over from a daemon that died and is removed.
+ * Anything else, a live daemon or a file that isn't a socket, is kept.
+ */
+static bool claim_path(const struct sockaddr_un *addr) {
+    const char *path = addr->sun_path;
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        if (errno == ENOENT) return true;
+        perror(path);
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "%s: exists and is not a socket\n", path);
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return false;
+    }
+    bool stale = connect(fd, (const struct sockaddr *)addr, sizeof *addr) != 0
+                 && errno == ECONNREFUSED;
+    close(fd);
+    if (!stale) {
+        fprintf(stderr, "%s: a daemon is already serving here\n", path);
+        return false;
+    }
+    if (unlink(path) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/* ---- public API ---- */
+
+/*
+ * Serve layouts on a Unix socket until SIGINT or SIGTERM. Graphs stay
+ * cached by name, at most opt->cache of them, and a changed graph is laid
+ * out starting from the ordering it had before.
+ */
+int serve_run(const char *path, const ServeOptions *opt) {
+    Server srv = {.opt = opt};
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (!claim_path(&addr)) return 1;
+    srv.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv.listen_fd < 0
+        || bind(srv.listen_fd, (struct sockaddr *)&addr, sizeof addr) != 0
+        || listen(srv.listen_fd, SOMAXCONN) != 0) {
+        perror(path);
+        return 1;
+    }
+    /* the dispatcher must never block anywhere but in poll */
+    if (pipe(srv.wake) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(srv.listen_fd, F_SETFL, O_NONBLOCK);
+    fcntl(srv.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(srv.wake[1], F_SETFL, O_NONBLOCK);
+
+    srv.cache = calloc(opt->cache, sizeof *srv.cache);
+    int jobs = opt->jobs > 0 ? opt->jobs
+                             : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    pthread_t *threads = malloc(jobs * sizeof *threads);
+    if (!srv.cache || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_mutex_init(&srv.queue_lock, NULL);
+    pthread_cond_init(&srv.queued, NULL);
+
+    /* workers never see the signals; this thread waits for them */
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+
+    int started = 0;
+    pthread_t dispatcher;
+    while (started < jobs
+           && pthread_create(&threads[started], NULL, worker, &srv) == 0)
+        started++;
+    if (started > 0 && pthread_create(&dispatcher, NULL, dispatch, &srv) != 0)
+        started = 0;
+    if (started == 0) {
+        fprintf(stderr, "Cannot start worker threads\n");
+    } else {
+        int sig;
+        sigwait(&stop, &sig);
+    }
+
+    /* workers may be mid-request; the process exit takes them down */
+    close(srv.listen_fd);
+    unlink(path);
+    return started ? 0 : 1;
+}
@@ -3,285 +3,462 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* ---- Phase 1: topological ordering for cycle breaking ---- */
+/* ---- helpers ---- */
+
+static int *arena_ints(Arena *a, int count) {
+    return arena_alloc(a, (size_t)(count > 0 ? count : 1) * sizeof(int));
+}
 
-static void cycle_analysis(const Graph *g, NodeList *order) {
-    Graph tmp;
-    memcpy(&tmp, g, sizeof tmp);
+/* Take a node out of the peeling bookkeeping, as graph_remove_node would. */
+static void peel(const Graph *g, int node, bool *alive,
+                 int *in_left, int *out_left) {
+    alive[node] = false;
+    for (int i = 0; i < g->nodes[node].out_count; i++) {
+        int child = g->nodes[node].adj_out[i];
+        if (alive[child]) in_left[child]--;
+    }
+    for (int i = 0; i < g->nodes[node].in_count; i++) {
+        int parent = g->nodes[node].adj_in[i];
+        if (alive[parent]) out_left[parent]--;
+    }
+}
 
-    NodeList left = {.count = 0}, right = {.count = 0};
+/* ---- Phase 1: topological ordering for cycle breaking ---- */
 
-    for (;;) {
-        bool any_active = false;
-        for (int i = 0; i < tmp.count; i++)
-            if (tmp.nodes[i].active) { any_active = true; break; }
-        if (!any_active) break;
+/* Number of nodes ordered, or -1 when out of memory. */
+static int cycle_analysis(Arena *a, const Graph *g, int *order) {
+    int n = g->count;
+    int *in_left = arena_ints(a, n), *out_left = arena_ints(a, n);
+    int *right = arena_ints(a, n), *batch = arena_ints(a, n);
+    bool *alive = arena_alloc(a, n * sizeof *alive);
+    if (!in_left || !out_left || !right || !batch || !alive) return -1;
+
+    int remaining = 0;
+    for (int i = 0; i < n; i++) {
+        if (!g->nodes[i].active) continue;
+        alive[i] = true;
+        in_left[i] = g->nodes[i].in_count;
+        out_left[i] = g->nodes[i].out_count;
+        remaining++;
+    }
 
+    int left_count = 0, right_count = 0;
+    while (remaining > 0) {
         /* sources (no incoming edges) */
-        NodeList batch = {.count = 0};
-        for (int i = 0; i < tmp.count; i++)
-            if (tmp.nodes[i].active && tmp.nodes[i].in_count == 0)
-                batch.items[batch.count++] = i;
-
-        if (batch.count) {
-            for (int i = 0; i < batch.count; i++)
-                left.items[left.count++] = batch.items[i];
-            for (int i = 0; i < batch.count; i++)
-                graph_remove_node(&tmp, batch.items[i]);
+        int batch_count = 0;
+        for (int i = 0; i < n; i++)
+            if (alive[i] && in_left[i] == 0) batch[batch_count++] = i;
+
+        if (batch_count) {
+            for (int i = 0; i < batch_count; i++) {
+                order[left_count++] = batch[i];
+                peel(g, batch[i], alive, in_left, out_left);
+            }
+            remaining -= batch_count;
             continue;
         }
 
         /* sinks (no outgoing edges) */
-        batch.count = 0;
-        for (int i = 0; i < tmp.count; i++)
-            if (tmp.nodes[i].active && tmp.nodes[i].out_count == 0)
-                batch.items[batch.count++] = i;
-
-        if (batch.count) {
-            for (int i = 0; i < batch.count; i++)
-                right.items[right.count++] = batch.items[i];
-            for (int i = 0; i < batch.count; i++)
-                graph_remove_node(&tmp, batch.items[i]);
+        for (int i = 0; i < n; i++)
+            if (alive[i] && out_left[i] == 0) batch[batch_count++] = i;
+
+        if (batch_count) {
+            for (int i = 0; i < batch_count; i++) {
+                right[right_count++] = batch[i];
+                peel(g, batch[i], alive, in_left, out_left);
+            }
+            remaining -= batch_count;
             continue;
         }
 
         /* max out-rank node (most outgoing minus incoming) */
         int best = -1, best_rank = -999999;
-        for (int i = 0; i < tmp.count; i++) {
-            if (!tmp.nodes[i].active) continue;
-            int rank = tmp.nodes[i].out_count - tmp.nodes[i].in_count;
+        for (int i = 0; i < n; i++) {
+            if (!alive[i]) continue;
+            int rank = out_left[i] - in_left[i];
             if (rank > best_rank) { best_rank = rank; best = i; }
         }
-        left.items[left.count++] = best;
-        graph_remove_node(&tmp, best);
+        order[left_count++] = best;
+        peel(g, best, alive, in_left, out_left);
+        remaining--;
     }
 
-    order->count = 0;
-    for (int i = 0; i < left.count; i++)
-        order->items[order->count++] = left.items[i];
-    for (int i = 0; i < right.count; i++)
-        order->items[order->count++] = right.items[i];
-}
-
-/* ---- Phase 1b: reverse backedges ---- */
-
-static void invert_back_edges(const Graph *orig, const NodeList *order,
-                              Graph *out) {
-    memcpy(out, orig, sizeof *out);
-
-    int position[MAX_NODES];
-    memset(position, 0xff, sizeof position);
-    for (int i = 0; i < order->count; i++) position[order->items[i]] = i;
-
-    int back_edges[MAX_EDGES][2];
-    int back_count = 0;
-    for (int i = 0; i < order->count; i++) {
-        int node = order->items[i];
-        for (int j = 0; j < out->nodes[node].out_count; j++) {
-            int child = out->nodes[node].adj_out[j];
-            if (position[child] < position[node] && back_count < MAX_EDGES) {
-                back_edges[back_count][0] = node;
-                back_edges[back_count][1] = child;
-                back_count++;
-            }
-        }
-    }
-    graph_twist(out, back_edges, back_count);
+    memcpy(order + left_count, right, right_count * sizeof *right);
+    return left_count + right_count;
 }
 
 /* ---- Phase 2: assign nodes to levels ---- */
 
-static void level_assignment(const Graph *g, NodeList *levels,
-                             int *level_count) {
-    Graph tmp;
-    memcpy(&tmp, g, sizeof tmp);
-    *level_count = 0;
-
-    for (;;) {
-        bool any_active = false;
-        for (int i = 0; i < tmp.count; i++)
-            if (tmp.nodes[i].active) { any_active = true; break; }
-        if (!any_active) break;
-
-        NodeList *level = &levels[*level_count];
-        level->count = 0;
-        for (int i = 0; i < tmp.count; i++)
-            if (tmp.nodes[i].active && tmp.nodes[i].out_count == 0)
-                level->items[level->count++] = i;
-        (*level_count)++;
-        for (int i = 0; i < level->count; i++)
-            graph_remove_node(&tmp, level->items[i]);
+/*
+ * Edges pointing backwards in the cycle-breaking order are treated as
+ * reversed, so the acyclic graph is never materialised. A node's level is
+ * its longest distance to a sink, counted from the top. Returns the
+ * number of levels, or -1 when out of memory.
+ */
+static int level_assignment(Arena *a, const Graph *g, const int *order,
+                            int order_count, int *node_level) {
+    int *position = arena_ints(a, g->count);
+    int *height = arena_ints(a, g->count);
+    if (!position || !height) return -1;
+    for (int i = 0; i < order_count; i++) position[order[i]] = i;
+
+    int max_height = 0;
+    for (int i = order_count - 1; i >= 0; i--) {
+        const Node *node = &g->nodes[order[i]];
+        int h = 0;
+        for (int j = 0; j < node->out_count; j++) {
+            int child = node->adj_out[j];
+            if (position[child] > i && height[child] + 1 > h)
+                h = height[child] + 1;
+        }
+        for (int j = 0; j < node->in_count; j++) {
+            int parent = node->adj_in[j];
+            if (position[parent] > i && height[parent] + 1 > h)
+                h = height[parent] + 1;
+        }
+        height[order[i]] = h;
+        if (h > max_height) max_height = h;
     }
 
-    /* reverse (built bottom-up) */
-    for (int i = 0; i < *level_count / 2; i++) {
-        NodeList swap = levels[i];
-        levels[i] = levels[*level_count - 1 - i];
-        levels[*level_count - 1 - i] = swap;
-    }
+    for (int i = 0; i < g->count; i++) node_level[i] = -1;
+    for (int i = 0; i < order_count; i++)
+        node_level[order[i]] = max_height - height[order[i]];
+    return order_count ? max_height + 1 : 0;
 }
 
-/* ---- Phase 2b: insert dummy nodes on multi-level edges ---- */
-
-static void solve_mid_transition(Graph *g, int src, int dst,
-                                 NodeList *levels, int *dummy_id) {
-    int level_from = g->nodes[src].level;
-    int level_to   = g->nodes[dst].level;
-    int span = abs(level_to - level_from) - 1;
-    if (span <= 0) return;
-    if (g->count + span > MAX_NODES) return;
-
-    int step = (level_to > level_from) ? 1 : -1;
-    graph_remove_edge(g, src, dst);
-
-    int prev = src;
-    for (int lvl = level_from + step; lvl != level_to; lvl += step) {
-        int dummy = g->count++;
-        Node *dn = &g->nodes[dummy];
-        memset(dn, 0, sizeof *dn);
-        snprintf(dn->name, MAX_NAME, "_d%d", (*dummy_id)++);
-        dn->active = true;
-        dn->is_dummy = true;
-        dn->level = lvl;
-        g->nodes[prev].adj_out[g->nodes[prev].out_count++] = dummy;
-        dn->adj_in[dn->in_count++] = prev;
-        levels[lvl].items[levels[lvl].count++] = dummy;
-        prev = dummy;
+/* ---- Phase 2b: chain slots on multi-level edges ---- */
+
+/*
+ * An edge spanning several levels becomes a chain of slots, one per level it
+ * crosses. Slots only exist as SLOT_ITEM entries in the level lists, so they
+ * cost an int per level instead of a full Node.
+ */
+static bool get_in_between_nodes(Arena *a, const Graph *g, Layout *lay) {
+    int level_count = lay->level_count;
+    const int *node_level = lay->node_level;
+    int *capacity = arena_ints(a, level_count);
+    lay->levels = arena_alloc(a, level_count * sizeof *lay->levels);
+    if (!capacity || !lay->levels) return false;
+
+    int chain_count = 0, slot_count = 0;
+    for (int i = 0; i < g->count; i++) {
+        if (node_level[i] < 0) continue;
+        capacity[node_level[i]]++;
+        for (int k = 0; k < g->nodes[i].out_count; k++) {
+            int child = g->nodes[i].adj_out[k];
+            int lo = node_level[i], hi = node_level[child];
+            if (lo > hi) { int swap = lo; lo = hi; hi = swap; }
+            if (hi - lo <= 1) continue;
+            chain_count++;
+            slot_count += hi - lo - 1;
+            for (int lvl = lo + 1; lvl < hi; lvl++) capacity[lvl]++;
+        }
     }
-    g->nodes[prev].adj_out[g->nodes[prev].out_count++] = dst;
-    g->nodes[dst].adj_in[g->nodes[dst].in_count++] = prev;
-}
-
-static void get_in_between_nodes(const Graph *orig, Graph *out,
-                                 NodeList *levels, int level_count) {
-    memcpy(out, orig, sizeof *out);
-    for (int i = 0; i < level_count; i++)
-        for (int j = 0; j < levels[i].count; j++)
-            out->nodes[levels[i].items[j]].level = i;
+    for (int lvl = 0; lvl < level_count; lvl++) {
+        lay->levels[lvl].items = arena_ints(a, capacity[lvl]);
+        if (!lay->levels[lvl].items) return false;
+    }
+    lay->chains = arena_alloc(a, (chain_count ? chain_count : 1)
+                                 * sizeof *lay->chains);
+    lay->slot_chain = arena_ints(a, slot_count);
+    if (!lay->chains || !lay->slot_chain) return false;
+
+    NodeList *levels = lay->levels;
+    for (int i = 0; i < g->count; i++)
+        if (node_level[i] >= 0) {
+            NodeList *level = &levels[node_level[i]];
+            level->items[level->count++] = i;
+        }
 
-    int multi_edges[MAX_EDGES][2];
-    int multi_count = 0;
+    lay->chain_count = lay->slot_count = 0;
     for (int lvl = 0; lvl < level_count; lvl++)
         for (int j = 0; j < levels[lvl].count; j++) {
             int node = levels[lvl].items[j];
-            for (int k = 0; k < out->nodes[node].out_count; k++) {
-                int child = out->nodes[node].adj_out[k];
-                if (abs(out->nodes[child].level - lvl) > 1
-                    && multi_count < MAX_EDGES) {
-                    multi_edges[multi_count][0] = node;
-                    multi_edges[multi_count][1] = child;
-                    multi_count++;
+            if (IS_SLOT(node)) continue;
+            for (int k = 0; k < g->nodes[node].out_count; k++) {
+                int child = g->nodes[node].adj_out[k];
+                int level_to = node_level[child];
+                if (abs(level_to - lvl) <= 1) continue;
+
+                int step = (level_to > lvl) ? 1 : -1;
+                int c = lay->chain_count++;
+                Chain *chain = &lay->chains[c];
+                chain->src = node;
+                chain->dst = child;
+                chain->first = lay->slot_count;
+                chain->len = abs(level_to - lvl) - 1;
+                for (int l = lvl + step; l != level_to; l += step) {
+                    int slot = lay->slot_count++;
+                    lay->slot_chain[slot] = c;
+                    levels[l].items[levels[l].count++] = SLOT_ITEM(slot);
                 }
             }
         }
-
-    int dummy_id = 0;
-    for (int i = 0; i < multi_count; i++)
-        solve_mid_transition(out, multi_edges[i][0], multi_edges[i][1],
-                             levels, &dummy_id);
+    return true;
 }
 
 /* ---- Phase 3: crossing minimisation ---- */
 
-static int neighbor_indices(const Graph *g, int node,
-                            const NodeList *level, int *out) {
-    int count = 0;
-    for (int i = 0; i < g->nodes[node].out_count; i++) {
-        int neighbor = g->nodes[node].adj_out[i];
-        for (int j = 0; j < level->count; j++)
-            if (level->items[j] == neighbor) { out[count++] = j; break; }
+/* Index of a level entry in the node-then-slot position table. */
+static int item_key(const Graph *g, int item) {
+    return IS_SLOT(item) ? g->count + ITEM_SLOT(item) : item;
+}
+
+/* Chain slots next to each node: the first slot of chains leaving it and
+ * the last slot of chains entering it, in end_off/end_slot CSR form. */
+static int *chain_ends(Arena *a, const Graph *g, const Layout *lay,
+                       int *end_off) {
+    int *end_slot = arena_ints(a, 2 * lay->chain_count);
+    int *fill = arena_ints(a, g->count);
+    if (!end_slot || !fill) return NULL;
+    for (int c = 0; c < lay->chain_count; c++) {
+        end_off[lay->chains[c].src + 1]++;
+        end_off[lay->chains[c].dst + 1]++;
     }
-    for (int i = 0; i < g->nodes[node].in_count; i++) {
-        int neighbor = g->nodes[node].adj_in[i];
-        for (int j = 0; j < level->count; j++)
-            if (level->items[j] == neighbor) { out[count++] = j; break; }
+    for (int i = 0; i < g->count; i++) end_off[i + 1] += end_off[i];
+
+    for (int c = 0; c < lay->chain_count; c++) {
+        const Chain *chain = &lay->chains[c];
+        end_slot[end_off[chain->src] + fill[chain->src]++] = chain->first;
+        end_slot[end_off[chain->dst] + fill[chain->dst]++] =
+            chain->first + chain->len - 1;
     }
-    return count;
+    return end_slot;
 }
 
-static void cost_matrix(const Graph *g, const NodeList *upper,
-                        const NodeList *lower, int *matrix) {
-    int n = upper->count;
-    memset(matrix, 0, MAX_NODES * MAX_NODES * sizeof(int));
+/* Positions in the lower level of each upper entry's neighbours, packed
+ * back to back; nbr_off[ui]..nbr_off[ui + 1] delimits entry ui's slice. */
+static int *neighbor_indices(Arena *a, const Graph *g, const Layout *lay,
+                             const NodeList *upper, const int *position,
+                             const int *end_off, const int *end_slot,
+                             int *nbr_off) {
+    int total = 0;
+    for (int ui = 0; ui < upper->count; ui++) {
+        int item = upper->items[ui];
+        if (IS_SLOT(item)) { total += 2; continue; }
+        total += g->nodes[item].out_count + g->nodes[item].in_count
+                 + end_off[item + 1] - end_off[item];
+    }
+    int *nbr = arena_ints(a, total);
+    if (!nbr) return NULL;
 
+    int count = 0;
+    for (int ui = 0; ui < upper->count; ui++) {
+        int item = upper->items[ui];
+        nbr_off[ui] = count;
+        if (IS_SLOT(item)) {
+            int slot = ITEM_SLOT(item);
+            const Chain *chain = &lay->chains[lay->slot_chain[slot]];
+            int prev = slot == chain->first ? chain->src : SLOT_ITEM(slot - 1);
+            int next = slot == chain->first + chain->len - 1
+                       ? chain->dst : SLOT_ITEM(slot + 1);
+            if (position[item_key(g, prev)] >= 0)
+                nbr[count++] = position[item_key(g, prev)];
+            if (position[item_key(g, next)] >= 0)
+                nbr[count++] = position[item_key(g, next)];
+            continue;
+        }
+        const Node *node = &g->nodes[item];
+        for (int i = 0; i < node->out_count; i++)
+            if (position[node->adj_out[i]] >= 0)
+                nbr[count++] = position[node->adj_out[i]];
+        for (int i = 0; i < node->in_count; i++)
+            if (position[node->adj_in[i]] >= 0)
+                nbr[count++] = position[node->adj_in[i]];
+        for (int i = end_off[item]; i < end_off[item + 1]; i++)
+            if (position[g->count + end_slot[i]] >= 0)
+                nbr[count++] = position[g->count + end_slot[i]];
+    }
+    nbr_off[upper->count] = count;
+    return nbr;
+}
+
+static void cost_matrix(int n, const int *nbr_off, const int *nbr,
+                        int *matrix) {
+    memset(matrix, 0, (size_t)n * n * sizeof *matrix);
     for (int ui = 0; ui < n; ui++)
-        for (int vi = ui + 1; vi < n; vi++) {
-            int idx_u[MAX_ADJ * 2], idx_v[MAX_ADJ * 2];
-            int count_u = neighbor_indices(g, upper->items[ui], lower, idx_u);
-            int count_v = neighbor_indices(g, upper->items[vi], lower, idx_v);
-            for (int a = 0; a < count_u; a++)
-                for (int b = 0; b < count_v; b++) {
-                    if (idx_u[a] > idx_v[b]) matrix[ui * MAX_NODES + vi]++;
-                    if (idx_u[a] < idx_v[b]) matrix[vi * MAX_NODES + ui]++;
+        for (int vi = ui + 1; vi < n; vi++)
+            for (int p = nbr_off[ui]; p < nbr_off[ui + 1]; p++)
+                for (int q = nbr_off[vi]; q < nbr_off[vi + 1]; q++) {
+                    if (nbr[p] > nbr[q]) matrix[ui * n + vi]++;
+                    if (nbr[p] < nbr[q]) matrix[vi * n + ui]++;
                 }
-        }
 }
 
-static void cross_sort(const int *indices, int count, const int *matrix,
-                       int *out, int *out_count) {
-    if (count < 2) {
-        memcpy(out, indices, count * sizeof *indices);
-        *out_count = count;
-        return;
-    }
+/* Stable merge sort by pairwise crossing cost; tmp holds count ints. */
+static void cross_sort(int *indices, int count, const int *matrix, int n,
+                       int *tmp) {
+    if (count < 2) return;
     int pivot = count / 2;
-    int left[MAX_NODES], left_count;
-    int right_half[MAX_NODES], right_count;
-    cross_sort(indices, pivot, matrix, left, &left_count);
-    cross_sort(indices + pivot, count - pivot, matrix,
-               right_half, &right_count);
-
-    int li = 0, ri = 0;
-    *out_count = 0;
+    cross_sort(indices, pivot, matrix, n, tmp);
+    cross_sort(indices + pivot, count - pivot, matrix, n, tmp);
+
+    memcpy(tmp, indices, count * sizeof *indices);
+    const int *left = tmp, *right_half = tmp + pivot;
+    int left_count = pivot, right_count = count - pivot;
+    int li = 0, ri = 0, out_count = 0;
     while (li < left_count && ri < right_count) {
-        if (matrix[left[li] * MAX_NODES + right_half[ri]] <=
-            matrix[right_half[ri] * MAX_NODES + left[li]])
-            out[(*out_count)++] = left[li++];
+        if (matrix[left[li] * n + right_half[ri]] <=
+            matrix[right_half[ri] * n + left[li]])
+            indices[out_count++] = left[li++];
         else
-            out[(*out_count)++] = right_half[ri++];
+            indices[out_count++] = right_half[ri++];
     }
-    while (li < left_count) out[(*out_count)++] = left[li++];
-    while (ri < right_count) out[(*out_count)++] = right_half[ri++];
+    while (li < left_count) indices[out_count++] = left[li++];
+    while (ri < right_count) indices[out_count++] = right_half[ri++];
 }
 
-static void two_level_cross_min(const Graph *g, NodeList *levels,
-                                int level_count) {
-    if (level_count < 2) return;
+/* Bottom-to-top sweep: each level from hi down to lo is reordered against
+ * the already ordered level below it; the others are left as they are. */
+static bool two_level_cross_min(Arena *a, const Graph *g, Layout *lay,
+                                int lo, int hi) {
+    NodeList *levels = lay->levels;
+    int level_count = lay->level_count;
+    if (level_count < 2) return true;
 
-    int *matrix = malloc(MAX_NODES * MAX_NODES * sizeof(int));
-    if (!matrix) return;
+    int max_count = 0;
+    for (int i = 0; i < level_count; i++)
+        if (levels[i].count > max_count) max_count = levels[i].count;
+
+    int keys = g->count + lay->slot_count;
+    int *end_off = arena_ints(a, g->count + 1);
+    int *end_slot = end_off ? chain_ends(a, g, lay, end_off) : NULL;
+    int *matrix = arena_ints(a, max_count * max_count);
+    int *position = arena_ints(a, keys);
+    int *nbr_off = arena_ints(a, max_count + 1);
+    int *indices = arena_ints(a, max_count);
+    int *items = arena_ints(a, max_count);
+    int *tmp = arena_ints(a, max_count);
+    if (!end_slot || !matrix || !position || !nbr_off || !indices
+        || !items || !tmp)
+        return false;
+    for (int i = 0; i < keys; i++) position[i] = -1;
+
+    for (int i = hi < level_count - 2 ? hi : level_count - 2; i >= lo; i--) {
+        NodeList *upper = &levels[i];
+        const NodeList *lower = &levels[i + 1];
+        for (int j = 0; j < lower->count; j++)
+            position[item_key(g, lower->items[j])] = j;
+        int *nbr = neighbor_indices(a, g, lay, upper, position,
+                                    end_off, end_slot, nbr_off);
+        for (int j = 0; j < lower->count; j++)
+            position[item_key(g, lower->items[j])] = -1;
+        if (!nbr) return false;
+
+        cost_matrix(upper->count, nbr_off, nbr, matrix);
+        for (int j = 0; j < upper->count; j++) indices[j] = j;
+        cross_sort(indices, upper->count, matrix, upper->count, tmp);
+
+        for (int j = 0; j < upper->count; j++)
+            items[j] = upper->items[indices[j]];
+        memcpy(upper->items, items, upper->count * sizeof *items);
+    }
+    return true;
+}
 
-    NodeList result[MAX_LEVELS];
-    int result_count = 0;
-    result[result_count++] = levels[level_count - 1];
+/* ---- Phase 2c: seed the ordering from a previous layout ---- */
 
-    for (int i = level_count - 2; i >= 0; i--) {
-        cost_matrix(g, &levels[i], &result[result_count - 1], matrix);
-        int indices[MAX_NODES], sorted[MAX_NODES], sorted_count;
-        for (int j = 0; j < levels[i].count; j++) indices[j] = j;
-        cross_sort(indices, levels[i].count, matrix, sorted, &sorted_count);
+typedef struct {
+    double key;
+    int rank;
+    int item;
+} Seed;
 
-        NodeList reordered = {.count = 0};
-        for (int j = 0; j < sorted_count; j++)
-            reordered.items[reordered.count++] = levels[i].items[sorted[j]];
-        result[result_count++] = reordered;
-    }
-    for (int i = 0; i < result_count; i++)
-        levels[i] = result[result_count - 1 - i];
+static int seed_cmp(const void *pa, const void *pb) {
+    const Seed *a = pa, *b = pb;
+    bool a_none = a->key < 0, b_none = b->key < 0;
+    if (a_none != b_none) return a_none ? 1 : -1;
+    if (!a_none && a->key != b->key) return a->key < b->key ? -1 : 1;
+    return a->rank - b->rank;
+}
 
-    free(matrix);
+/*
+ * Sort every level by its hinted position before the sweep, so that cost
+ * ties leave nodes where the previous layout had them. Slots follow the
+ * source of their chain; entries without a hint keep their order, last.
+ */
+static bool seed_order(Arena *a, const double *hint, Layout *lay) {
+    for (int lvl = 0; lvl < lay->level_count; lvl++) {
+        NodeList *level = &lay->levels[lvl];
+        Seed *seeds = arena_alloc(a, (level->count + 1) * sizeof *seeds);
+        if (!seeds) return false;
+        for (int j = 0; j < level->count; j++) {
+            int item = level->items[j];
+            int node = IS_SLOT(item)
+                ? lay->chains[lay->slot_chain[ITEM_SLOT(item)]].src : item;
+            seeds[j] = (Seed){hint[node], j, item};
+        }
+        qsort(seeds, level->count, sizeof *seeds, seed_cmp);
+        for (int j = 0; j < level->count; j++) level->items[j] = seeds[j].item;
+    }
+    return true;
 }
 
 /* ---- Main entry point ---- */
 
-void sugiyama(const Graph *orig, Graph *out,
-              NodeList *levels, int *level_count) {
-    NodeList order;
-    cycle_analysis(orig, &order);
+size_t sugiyama_arena_size(const Graph *g) {
+    size_t edges = 0;
+    for (int i = 0; i < g->count; i++) edges += g->nodes[i].out_count;
+    /* about 22 ints of per-node bookkeeping across the phases, plus chain
+     * slots and neighbour slices per edge; overflow blocks take the rest */
+    return (24 * (size_t)g->count + 8 * edges) * sizeof(int);
+}
 
-    Graph acyclic;
-    invert_back_edges(orig, &order, &acyclic);
-    level_assignment(&acyclic, levels, level_count);
-    get_in_between_nodes(orig, out, levels, *level_count);
-    two_level_cross_min(out, levels, *level_count);
+/* Levels spanned by the nodes marked in redo, or all of them. */
+static void redo_levels(const Graph *g, const Layout *lay, const bool *redo,
+                        int *lo, int *hi) {
+    *lo = 0;
+    *hi = lay->level_count - 1;
+    if (!redo) return;
+    *lo = lay->level_count;
+    *hi = -1;
+    for (int i = 0; i < g->count; i++) {
+        if (!redo[i]) continue;
+        int lvl = lay->node_level[i];
+        if (lvl < *lo) *lo = lvl;
+        if (lvl > *hi) *hi = lvl;
+    }
+}
+
+/*
+ * hint, if not NULL, gives each node a preferred horizontal position in
+ * [0, 1) (negative for none), typically from layout_positions. redo, if
+ * not NULL alongside hint, marks the nodes that changed: only the levels
+ * they span are reordered, and every other level keeps the hinted order.
+ * Returns false, with an empty layout, when the arena runs out of memory.
+ */
+bool sugiyama(Arena *a, const Graph *g, const double *hint, const bool *redo,
+              Layout *out) {
+    memset(out, 0, sizeof *out);
+
+    int *order = arena_ints(a, g->count);
+    out->node_level = arena_ints(a, g->count);
+    if (!order || !out->node_level) goto fail;
+
+    int order_count = cycle_analysis(a, g, order);
+    if (order_count < 0) goto fail;
+    out->level_count = level_assignment(a, g, order, order_count,
+                                        out->node_level);
+    if (out->level_count < 0 || !get_in_between_nodes(a, g, out)
+        || (hint && !seed_order(a, hint, out)))
+        goto fail;
+    int lo, hi;
+    redo_levels(g, out, hint ? redo : NULL, &lo, &hi);
+    if (!two_level_cross_min(a, g, out, lo, hi)) goto fail;
+    return true;
+
+fail:
+    memset(out, 0, sizeof *out);
+    return false;
+}
+
+/* Horizontal position of every node as a fraction of its level. */
+void layout_positions(const Graph *g, const Layout *lay, double *pos) {
+    for (int i = 0; i < g->count; i++) pos[i] = -1;
+    for (int lvl = 0; lvl < lay->level_count; lvl++) {
+        const NodeList *level = &lay->levels[lvl];
+        for (int j = 0; j < level->count; j++)
+            if (!IS_SLOT(level->items[j]))
+                pos[level->items[j]] = (j + 0.5) / level->count;
+    }
 }